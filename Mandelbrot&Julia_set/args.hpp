@@ -0,0 +1,35 @@
+#pragma once
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// Numbers on the command lines of the tools. The whole argument has to parse; anything else is
+// rejected rather than read as 0 or cut short like atof and atoi would.
+
+// Plain or exponent notation, finite.
+inline bool parseNumber(const char* text, double& value) {
+    char* end;
+    double parsed = strtod(text, &end);
+    if (end == text || *end != '\0' || !std::isfinite(parsed)) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Digits only, no sign, at most the largest T.
+template <typename T>
+bool parseCount(const char* text, T& value) {
+    if (*text < '0' || *text > '9') {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > (unsigned long long)std::numeric_limits<T>::max()) {
+        return false;
+    }
+    value = (T)parsed;
+    return true;
+}
@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fractal.hpp"
+#include "thread_pool.hpp"
+#include "simd_kernels.hpp"
+#include "fixed_point.hpp"
+#include "perturbation.hpp"
+#include "palette.hpp"
+
+using namespace std;
+
+// Benchmark of the escape-time kernels and of a full-resolution frame on fixed viewports.
+// ftl_bench --size 512x490 --reps 5 --threads 1,8 --json bench.json
+//
+// Every (viewport, kernel, thread count) renders the frame the way the app's full-resolution pass
+// does: 32px tiles over the work-stealing pool, in every precision that resolves the view's pixels.
+// "iterations" is the sum of the per-pixel counts, i.e. the work the brute-force loop would do,
+// so shortcuts show up as fewer ns per iteration.
+// The "palette" rows colour the last frame of the view through the lookup table, the "palette-poly"
+// rows with the per-pixel polynomial it replaced; both count one iteration per pixel.
+// Where a view has a brute-force frame, every other kernel is checked against it: "interior" counts
+// the pixels one of them calls interior and the other does not, "counts" the pixels both let escape
+// whose counts differ by more than count_tolerance. FMA and the wider or narrower types round
+// differently from the brute-force loop, and near the boundary the orbit amplifies that into
+// far-off counts: a few hundred pixels of the seahorse view, a broken kernel shows up as most of it.
+// --attraction turns on the heuristic interior test (EscapeParams::attraction) in the frame rows;
+// the points it wrongly calls interior then show up in "interior" too.
+
+struct BenchView {
+    string name;
+    string center_x, center_y; // decimal strings so the deep view keeps all its digits
+    double span_x;
+    double max_iter;
+    bool julia;
+    double c_re, c_im;
+};
+
+static const BenchView standard_views[] = {
+    {"full", "-0.5", "0", 4.0, 1000, false, 0, 0},
+    {"seahorse", "-0.745", "0.11", 0.03, 2000, false, 0, 0},
+    {"past-double", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-10, 5000,
+     false, 0, 0},
+    {"deep", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-14, 5000,
+     false, 0, 0},
+    {"past-long-double", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-22,
+     20000, false, 0, 0}, // its pixels escape after about 10000 iterations
+    {"dendrite", "0", "0", 3.2, 1000, true, 0, 1},
+};
+
+struct BenchOptions {
+    int width = 512, height = 490;
+    int reps = 5;
+    vector<unsigned> threads;
+    string json;
+    string filter; // only views whose name contains it
+    bool attraction = false;
+};
+
+struct BenchKernel {
+    string name;
+    enum Kind { brute, escape, perturbation, distance } kind;
+    SimdLevel level;
+    Precision precision;
+};
+
+struct BenchResult {
+    string view, kernel;
+    unsigned threads;
+    double frame_ms;
+    double iterations;
+    double pixels;
+    long long interior_mismatches = -1; // both -1 without a brute-force frame to compare with
+    long long count_mismatches = -1;
+};
+
+// iterations an escaping pixel's count may differ from the brute-force loop's
+const double count_tolerance = 1;
+
+static void usage() {
+    cerr << "usage: ftl_bench [--size WxH] [--reps N] [--threads N,N,...] [--view name] [--json file.json]\n"
+            "                 [--attraction]\n";
+}
+
+static bool parseArgs(int argc, char* argv[], BenchOptions& options) {
+    for (int k = 1; k < argc; k++) {
+        string arg = argv[k];
+        auto need = [&](int count) { return k + count < argc; };
+
+        if (arg == "--size" && need(1)) {
+            if (sscanf(argv[++k], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 ||
+                options.height <= 0) {
+                return false;
+            }
+        } else if (arg == "--reps" && need(1)) {
+            options.reps = max(1, atoi(argv[++k]));
+        } else if (arg == "--threads" && need(1)) {
+            stringstream list(argv[++k]);
+            string item;
+            while (getline(list, item, ',')) {
+                if (atoi(item.c_str()) <= 0) {
+                    return false;
+                }
+                options.threads.push_back((unsigned)atoi(item.c_str()));
+            }
+        } else if (arg == "--view" && need(1)) {
+            options.filter = argv[++k];
+        } else if (arg == "--json" && need(1)) {
+            options.json = argv[++k];
+        } else if (arg == "--attraction") {
+            options.attraction = true;
+        } else {
+            return false;
+        }
+    }
+    if (options.threads.empty()) {
+        options.threads.push_back(1);
+        unsigned all = max(1u, thread::hardware_concurrency());
+        if (all > 1) {
+            options.threads.push_back(all);
+        }
+    }
+    return true;
+}
+
+// The view's centre coordinate to frac_limbs; the views are constants, so it always parses.
+static FixedPoint viewCoord(const string& text, int frac_limbs) {
+    FixedPoint value;
+    FixedPoint::fromString(text, frac_limbs, value);
+    return value;
+}
+
+static double viewSpacing(const BenchView& view, const BenchOptions& options) {
+    return view.span_x / options.width;
+}
+
+static double viewScale(const BenchView& view) {
+    double x = fabs(atof(view.center_x.c_str())), y = fabs(atof(view.center_y.c_str()));
+    return max(x, y) + view.span_x / 2;
+}
+
+// Kernels that can render the view: every SIMD level in every precision that resolves the pixels
+// (long double only runs scalar), and perturbation once double does not.
+static vector<BenchKernel> kernelsFor(const BenchView& view, const BenchOptions& options) {
+    double spacing = viewSpacing(view, options), scale = viewScale(view);
+    vector<BenchKernel> kernels;
+    if (precisionFits(Precision::Double, spacing, scale)) {
+        kernels.push_back({"brute", BenchKernel::brute, SimdLevel::Scalar, Precision::Double});
+    } else {
+        kernels.push_back({"perturbation", BenchKernel::perturbation, SimdLevel::Scalar, Precision::Double});
+    }
+    SimdLevel best = detectSimd();
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if ((int)level > (int)best) {
+            continue;
+        }
+        for (Precision precision :
+             {Precision::Float, Precision::Double, Precision::LongDouble, Precision::DoubleDouble}) {
+            bool scalar_only = precision == Precision::LongDouble && level != SimdLevel::Scalar;
+            if (!precisionFits(precision, spacing, scale) || scalar_only) {
+                continue;
+            }
+            kernels.push_back({string(simdName(level)) + "/" + precisionName(precision), BenchKernel::escape, level,
+                               precision});
+        }
+    }
+    return kernels;
+}
+
+// One frame into iters; returns the sum of the counts.
+static double renderFrame(const BenchView& view, const BenchKernel& kernel, const BenchOptions& options,
+                          ThreadPool& pool, vector<double>& iters) {
+    const int tile_size = 32;
+    int w = options.width, h = options.height;
+    int tiles_x = (w + tile_size - 1) / tile_size;
+    int tiles_y = (h + tile_size - 1) / tile_size;
+    double span_y = view.span_x * h / w;
+    EscapeParams params = {view.julia, view.c_re, view.c_im, view.max_iter};
+    params.precision = kernel.precision;
+    params.attraction = options.attraction;
+    iters.assign((size_t)w * h, 0.0);
+
+    bool deep = kernel.kind == BenchKernel::perturbation;
+    // escape kernels take offsets from the top-left corner, kept in double-double like the app does
+    params.origin_re = viewCoord(view.center_x, 4).toDoubleDouble() - view.span_x / 2;
+    params.origin_im = viewCoord(view.center_y, 4).toDoubleDouble() - span_y / 2;
+    double x_min = (double)params.origin_re, y_min = (double)params.origin_im;
+
+    // like the app, the reference orbit and series are part of the frame time
+    ReferenceOrbit orbit;
+    SeriesApproximation series;
+    if (deep) {
+        int frac = FixedPoint::limbsFor(min(view.span_x / w, span_y / h));
+        orbit = referenceOrbit(viewCoord(view.center_x, frac), viewCoord(view.center_y, frac), params);
+        series = seriesApproximation(orbit, params, view.span_x / 2, span_y / 2, min(view.span_x / w, span_y / h));
+    }
+
+    pool.parallelFor(tiles_x * tiles_y, [&](int tile) {
+        int i_begin = (tile % tiles_x) * tile_size;
+        int j_begin = (tile / tiles_x) * tile_size;
+        int i_end = min(i_begin + tile_size, w);
+        int j_end = min(j_begin + tile_size, h);
+        int count = i_end - i_begin;
+
+        double xs[tile_size];
+        for (int i = i_begin; i < i_end; i++) {
+            xs[i - i_begin] = deep ? view.span_x * i / w - view.span_x / 2 : view.span_x * i / w;
+        }
+        for (int j = j_begin; j < j_end; j++) {
+            double y = deep ? span_y * j / h - span_y / 2 : span_y * j / h;
+            double* out = &iters[(size_t)j * w + i_begin];
+            if (deep) {
+                perturbRow(orbit, &series, xs, y, count, params, out);
+            } else if (kernel.kind == BenchKernel::brute) {
+                for (int k = 0; k < count; k++) {
+                    Complex point(x_min + xs[k], y_min + y);
+                    out[k] = view.julia ? julia(point, Complex(view.c_re, view.c_im), view.max_iter)
+                                        : mandelbrot(point, view.max_iter);
+                }
+            } else {
+                escapeRow(kernel.level, xs, y, count, params, out);
+            }
+        }
+    });
+
+    double total = 0;
+    for (double n : iters) {
+        total += n;
+    }
+    return total;
+}
+
+// The escape loop before integer counters: double counter, sqrt bailout, no reuse of the squares.
+static double legacyEscape(double cr, double ci, double max_iter) {
+    double zr = 0, zi = 0, n = 0;
+    while (sqrt(zr * zr + zi * zi) <= 2 && n < max_iter) {
+        double t = zr * zr - zi * zi + cr;
+        zi = zr * zi + zi * zr + ci;
+        zr = t;
+        n++;
+    }
+    return n;
+}
+
+static double median(vector<double> samples) {
+    sort(samples.begin(), samples.end());
+    size_t mid = samples.size() / 2;
+    return samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+}
+
+template <typename F>
+static double timeMs(F fn) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void printResult(const BenchResult& result) {
+    printf("%-10s %-18s %3u threads %10.2f ms %10.2f Mpixel/s %8.3f ns/iter %7.3f Giter/s", result.view.c_str(),
+           result.kernel.c_str(), result.threads, result.frame_ms, result.pixels / result.frame_ms / 1e3,
+           result.frame_ms * 1e6 / max(1.0, result.iterations), result.iterations / result.frame_ms / 1e6);
+    if (result.interior_mismatches > 0) {
+        printf(" %lld interior", result.interior_mismatches);
+    }
+    if (result.count_mismatches > 0) {
+        printf(" %lld counts", result.count_mismatches);
+    }
+    printf("\n");
+}
+
+// Microbenchmark of the bare escape loop: one thread, no shortcuts, seahorse valley points that
+// mostly run long. "legacy" is the loop as it was before integer counters and the squared bailout,
+// "distance" the double kernel that also estimates the distance to the set.
+static void microBenchmark(const BenchOptions& options, vector<BenchResult>& results) {
+    const int side = 128;
+    const double max_iter = 2000;
+    vector<double> xs(side), ys(side), out(side), distance(side);
+    EscapeParams params = {false, 0, 0, max_iter};
+    params.shortcuts = false;
+    params.origin_re = -0.76;
+    params.origin_im = 0.09;
+    for (int i = 0; i < side; i++) {
+        xs[i] = 0.03 * i / side;
+    }
+
+    vector<BenchKernel> kernels = {{"legacy", BenchKernel::brute, SimdLevel::Scalar, Precision::Double},
+                                   {"brute", BenchKernel::brute, SimdLevel::Scalar, Precision::Double}};
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if ((int)level <= (int)detectSimd()) {
+            for (Precision precision : {Precision::Float, Precision::Double, Precision::DoubleDouble}) {
+                kernels.push_back({string(simdName(level)) + "/" + precisionName(precision), BenchKernel::escape,
+                                   level, precision});
+            }
+            kernels.push_back({string(simdName(level)) + "/distance", BenchKernel::distance, level, Precision::Double});
+        }
+    }
+
+    for (const BenchKernel& kernel : kernels) {
+        params.precision = kernel.precision;
+        double total = 0;
+        auto run = [&] {
+            total = 0;
+            for (int j = 0; j < side; j++) {
+                double y = 0.03 * j / side;
+                if (kernel.kind == BenchKernel::escape) {
+                    escapeRow(kernel.level, xs.data(), y, side, params, out.data());
+                } else if (kernel.kind == BenchKernel::distance) {
+                    fill(ys.begin(), ys.end(), y);
+                    escapePoints(kernel.level, xs.data(), ys.data(), side, params, out.data(), nullptr,
+                                 distance.data());
+                } else {
+                    for (int i = 0; i < side; i++) {
+                        Complex c(-0.76 + xs[i], 0.09 + y);
+                        out[i] = kernel.name == "legacy" ? legacyEscape(c.real, c.imag, max_iter)
+                                                         : mandelbrot(c, max_iter);
+                    }
+                }
+                for (int i = 0; i < side; i++) {
+                    total += out[i];
+                }
+            }
+        };
+        run();
+        vector<double> samples;
+        for (int rep = 0; rep < options.reps; rep++) {
+            samples.push_back(timeMs(run));
+        }
+        results.push_back({"micro", kernel.name, 1, median(samples), total, (double)side * side});
+        printResult(results.back());
+    }
+}
+
+static bool writeJson(const string& path, const BenchOptions& options, const vector<BenchResult>& results) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"reps\": %d,\n  \"simd\": \"%s\",\n  \"results\": [\n",
+            options.width, options.height, options.reps, simdName(detectSimd()));
+    for (size_t k = 0; k < results.size(); k++) {
+        const BenchResult& r = results[k];
+        fprintf(file,
+                "    {\"view\": \"%s\", \"kernel\": \"%s\", \"threads\": %u, \"frame_ms\": %.4f, "
+                "\"pixels_per_s\": %.1f, \"iterations\": %.0f, \"ns_per_iteration\": %.5f, "
+                "\"iterations_per_s\": %.1f",
+                r.view.c_str(), r.kernel.c_str(), r.threads, r.frame_ms, r.pixels / r.frame_ms * 1e3, r.iterations,
+                r.frame_ms * 1e6 / max(1.0, r.iterations), r.iterations / r.frame_ms * 1e3);
+        if (r.interior_mismatches >= 0) {
+            fprintf(file, ", \"interior_mismatches\": %lld, \"count_mismatches\": %lld", r.interior_mismatches,
+                    r.count_mismatches);
+        }
+        fprintf(file, "}%s\n", k + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    vector<BenchResult> results;
+    double pixels = (double)options.width * options.height;
+    vector<double> iters;
+
+    if (string("micro").find(options.filter) != string::npos) {
+        microBenchmark(options, results);
+    }
+    for (unsigned threads : options.threads) {
+        ThreadPool pool(threads);
+        for (const BenchView& view : standard_views) {
+            if (view.name.find(options.filter) == string::npos) {
+                continue;
+            }
+            double spacing = viewSpacing(view, options), scale = viewScale(view);
+            if (threads == options.threads.front()) {
+                Precision precision = selectPrecision(spacing, scale, view.max_iter);
+                printf("%s: %s selected\n", view.name.c_str(),
+                       precisionFits(precision, spacing, scale) ? precisionName(precision) : "perturbation");
+            }
+            vector<double> reference; // the brute-force frame, which kernelsFor() lists first
+            double cap = iterationCap(view.max_iter);
+            for (const BenchKernel& kernel : kernelsFor(view, options)) {
+                double total = renderFrame(view, kernel, options, pool, iters); // warm-up
+                vector<double> samples;
+                for (int rep = 0; rep < options.reps; rep++) {
+                    samples.push_back(timeMs([&] { renderFrame(view, kernel, options, pool, iters); }));
+                }
+                results.push_back({view.name, kernel.name, threads, median(samples), total, pixels});
+                if (kernel.kind == BenchKernel::brute) {
+                    reference = iters;
+                } else if (!reference.empty()) {
+                    long long interior = 0, counts = 0;
+                    for (size_t k = 0; k < iters.size(); k++) {
+                        bool inside = iters[k] >= cap, reference_inside = reference[k] >= cap;
+                        interior += inside != reference_inside;
+                        counts += !inside && !reference_inside && fabs(iters[k] - reference[k]) > count_tolerance;
+                    }
+                    results.back().interior_mismatches = interior;
+                    results.back().count_mismatches = counts;
+                }
+                printResult(results.back());
+            }
+
+            // colouring the last frame the way the app's colorize pass does, from its float buffer
+            vector<float> counts(iters.begin(), iters.end());
+            vector<uint32_t> colors(iters.size());
+            Palette palette;
+            palette.build(builtinGradients().front(), view.max_iter);
+            vector<double> samples;
+            for (int rep = 0; rep < options.reps; rep++) {
+                samples.push_back(timeMs([&] {
+                    pool.parallelFor(options.height, [&](int j) {
+                        size_t row = (size_t)j * options.width;
+                        palette.colorize(&counts[row], options.width, &colors[row]);
+                    });
+                }));
+            }
+            results.push_back({view.name, "palette", threads, median(samples), pixels, pixels});
+            printResult(results.back());
+
+            vector<Rgb> polynomial(iters.size());
+            samples.clear();
+            for (int rep = 0; rep < options.reps; rep++) {
+                samples.push_back(timeMs([&] {
+                    pool.parallelFor(options.height, [&](int j) {
+                        for (int i = 0; i < options.width; i++) {
+                            size_t at = (size_t)j * options.width + i;
+                            polynomial[at] = paletteColor(counts[at], view.max_iter);
+                        }
+                    });
+                }));
+            }
+            results.push_back({view.name, "palette-poly", threads, median(samples), pixels, pixels});
+            printResult(results.back());
+        }
+    }
+
+    if (!options.json.empty() && !writeJson(options.json, options, results)) {
+        cerr << "ftl_bench: cannot write " << options.json << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cmath>
+
+// Double-double: an unevaluated sum hi + lo of two doubles with |lo| <= ulp(hi) / 2, about 104 bits
+// of significand from plain double hardware. Only what the escape loops need: add, subtract, multiply
+// and square, each built from the error-free transformations below so they map one to one onto SIMD
+// lanes (see the double-double kernels in simd_kernels.hpp). The products need a fused multiply-add
+// to be exact; without hardware FMA, std::fma is a slow library call.
+
+struct DoubleDouble {
+    double hi, lo;
+
+    DoubleDouble(double value = 0) : hi(value), lo(0) {}
+    DoubleDouble(int value) : hi(value), lo(0) {}
+    DoubleDouble(double hi, double lo) : hi(hi), lo(lo) {}
+    // rounded to the nearest double-double; exact for an 80-bit long double
+    DoubleDouble(long double value) : hi((double)value), lo((double)(value - (long double)(double)value)) {}
+
+    explicit operator double() const {
+        return hi + lo;
+    }
+
+    explicit operator long double() const {
+        return (long double)hi + lo;
+    }
+
+    // a + b = s + e exactly
+    static DoubleDouble twoSum(double a, double b) {
+        double s = a + b;
+        double bb = s - a;
+        return {s, (a - (s - bb)) + (b - bb)};
+    }
+
+    // the same when |a| >= |b|
+    static DoubleDouble quickTwoSum(double a, double b) {
+        double s = a + b;
+        return {s, b - (s - a)};
+    }
+
+    // a * b = p + e exactly
+    static DoubleDouble twoProd(double a, double b) {
+        double p = a * b;
+        return {p, std::fma(a, b, -p)};
+    }
+
+    DoubleDouble operator+(const DoubleDouble& other) const {
+        // both halves summed exactly, so cancellation in hi (rr - ii near the boundary) keeps lo's digits
+        DoubleDouble s = twoSum(hi, other.hi), t = twoSum(lo, other.lo);
+        s = quickTwoSum(s.hi, s.lo + t.hi);
+        return quickTwoSum(s.hi, s.lo + t.lo);
+    }
+
+    DoubleDouble operator-() const {
+        return {-hi, -lo};
+    }
+
+    DoubleDouble operator-(const DoubleDouble& other) const {
+        return *this + -other;
+    }
+
+    DoubleDouble operator*(const DoubleDouble& other) const {
+        DoubleDouble p = twoProd(hi, other.hi);
+        return quickTwoSum(p.hi, p.lo + (hi * other.lo + lo * other.hi));
+    }
+
+    DoubleDouble square() const {
+        DoubleDouble p = twoProd(hi, hi);
+        return quickTwoSum(p.hi, p.lo + 2 * hi * lo);
+    }
+
+    bool operator==(const DoubleDouble& other) const {
+        return hi == other.hi && lo == other.lo;
+    }
+
+    // normalized values compare by hi first, then lo
+    bool operator>(const DoubleDouble& other) const {
+        return hi > other.hi || (hi == other.hi && lo > other.lo);
+    }
+};
+
+// The generic mulAdd() in fractal.hpp would call std::fma; a double-double product is already fused.
+inline DoubleDouble mulAdd(const DoubleDouble& a, const DoubleDouble& b, const DoubleDouble& c) {
+    return a * b + c;
+}
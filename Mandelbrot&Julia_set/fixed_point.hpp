@@ -0,0 +1,232 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "double_double.hpp"
+
+// Arbitrary-precision signed fixed-point number for deep-zoom coordinates and reference orbits.
+// Sign and magnitude; the magnitude is little-endian 32-bit limbs, the top limb is the integer
+// part and the frac_limbs below it are the fraction, so |value| < 2^32.
+class FixedPoint {
+public:
+    FixedPoint(double value = 0.0, int frac_limbs = 2) : limbs(frac_limbs + 1, 0), negative(value < 0) {
+        double v = std::fabs(value);
+        for (int k = frac_limbs; k >= 0; k--) {
+            double digit = std::floor(v);
+            limbs[k] = (uint32_t)digit;
+            v = (v - digit) * 4294967296.0;
+        }
+    }
+
+    // Fraction limbs needed to resolve `spacing` with 64 guard bits to spare.
+    static int limbsFor(double spacing) {
+        int bits = spacing > 0 ? (int)std::ceil(-std::log2(spacing)) : 0;
+        return std::max(2, (bits + 64 + 31) / 32);
+    }
+
+    // Parses a plain decimal such as "-0.7436438870371587047521915" into out. False, leaving out
+    // alone, for anything else: exponents, stray characters, no digits, or |value| >= 2^32.
+    static bool fromString(const std::string& text, int frac_limbs, FixedPoint& out) {
+        size_t pos = 0;
+        bool neg = false;
+        if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+            neg = text[pos++] == '-';
+        }
+        size_t point = text.find('.', pos);
+        std::string whole = text.substr(pos, point == std::string::npos ? std::string::npos : point - pos);
+        std::string frac = point == std::string::npos ? "" : text.substr(point + 1);
+        auto digits = [](const std::string& part) {
+            return std::all_of(part.begin(), part.end(), [](char c) { return c >= '0' && c <= '9'; });
+        };
+        if ((whole.empty() && frac.empty()) || !digits(whole) || !digits(frac)) {
+            return false;
+        }
+
+        FixedPoint result(0.0, frac_limbs);
+        // fraction by Horner from the last digit: f = (f + d) / 10
+        for (size_t k = frac.size(); k-- > 0;) {
+            result.addSmall((uint32_t)(frac[k] - '0'));
+            result.divSmall(10);
+        }
+        uint64_t integer = 0;
+        for (char digit : whole) {
+            integer = integer * 10 + (uint64_t)(digit - '0');
+            if (integer > UINT32_MAX) {
+                return false;
+            }
+        }
+        result.limbs[frac_limbs] += (uint32_t)integer;
+        result.negative = neg && !result.isZero();
+        out = result;
+        return true;
+    }
+
+    int fracLimbs() const {
+        return (int)limbs.size() - 1;
+    }
+
+    FixedPoint withPrecision(int frac_limbs) const {
+        FixedPoint result(0.0, frac_limbs);
+        int shift = frac_limbs - fracLimbs();
+        for (int k = 0; k < (int)limbs.size(); k++) {
+            if (k + shift >= 0 && k + shift < (int)result.limbs.size()) {
+                result.limbs[k + shift] = limbs[k];
+            }
+        }
+        result.negative = negative && !result.isZero();
+        return result;
+    }
+
+    double toDouble() const {
+        return toScalar<double>();
+    }
+
+    long double toLongDouble() const {
+        return toScalar<long double>();
+    }
+
+    // Each limb is exact in a double; the double-double sum keeps the top 104 bits or so.
+    DoubleDouble toDoubleDouble() const {
+        DoubleDouble result = 0.0;
+        for (int k = (int)limbs.size() - 1; k >= 0; k--) {
+            if (limbs[k] != 0) {
+                result = result + std::ldexp((double)limbs[k], 32 * (k - fracLimbs()));
+            }
+        }
+        return negative ? -result : result;
+    }
+
+    std::string toString(int digits) const {
+        std::string text = negative ? "-" : "";
+        text += std::to_string(limbs.back()) + ".";
+        FixedPoint frac = *this;
+        frac.limbs.back() = 0;
+        for (int k = 0; k < digits; k++) {
+            frac.mulSmall(10);
+            text += (char)('0' + frac.limbs.back());
+            frac.limbs.back() = 0;
+        }
+        return text;
+    }
+
+    FixedPoint operator-() const {
+        FixedPoint result = *this;
+        result.negative = !negative && !isZero();
+        return result;
+    }
+
+    FixedPoint operator+(const FixedPoint& other) const {
+        int frac = std::max(fracLimbs(), other.fracLimbs());
+        FixedPoint a = withPrecision(frac), b = other.withPrecision(frac);
+        if (a.negative == b.negative) {
+            a.addMagnitude(b);
+            return a;
+        }
+        if (compareMagnitude(a, b) >= 0) {
+            a.subMagnitude(b);
+            a.negative = a.negative && !a.isZero();
+            return a;
+        }
+        b.subMagnitude(a);
+        b.negative = b.negative && !b.isZero();
+        return b;
+    }
+
+    FixedPoint operator-(const FixedPoint& other) const {
+        return *this + (-other);
+    }
+
+    FixedPoint operator*(const FixedPoint& other) const {
+        int frac = std::max(fracLimbs(), other.fracLimbs());
+        FixedPoint a = withPrecision(frac), b = other.withPrecision(frac);
+        size_t n = a.limbs.size();
+        std::vector<uint64_t> product(2 * n + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < n; j++) {
+                uint64_t t = (uint64_t)a.limbs[i] * b.limbs[j] + product[i + j] + carry;
+                product[i + j] = t & 0xFFFFFFFFu;
+                carry = t >> 32;
+            }
+            product[i + n] += carry;
+        }
+        FixedPoint result(0.0, frac);
+        for (size_t k = 0; k < n; k++) {
+            result.limbs[k] = (uint32_t)product[k + frac];
+        }
+        result.negative = (a.negative != b.negative) && !result.isZero();
+        return result;
+    }
+
+private:
+    std::vector<uint32_t> limbs;
+    bool negative;
+
+    template <typename T>
+    T toScalar() const {
+        T result = 0;
+        for (int k = (int)limbs.size() - 1; k >= 0; k--) {
+            if (limbs[k] != 0) {
+                result += std::ldexp((T)limbs[k], 32 * (k - fracLimbs()));
+            }
+        }
+        return negative ? -result : result;
+    }
+
+    bool isZero() const {
+        return std::all_of(limbs.begin(), limbs.end(), [](uint32_t limb) { return limb == 0; });
+    }
+
+    static int compareMagnitude(const FixedPoint& a, const FixedPoint& b) {
+        for (int k = (int)a.limbs.size() - 1; k >= 0; k--) {
+            if (a.limbs[k] != b.limbs[k]) {
+                return a.limbs[k] < b.limbs[k] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    void addMagnitude(const FixedPoint& other) {
+        uint64_t carry = 0;
+        for (size_t k = 0; k < limbs.size(); k++) {
+            uint64_t t = (uint64_t)limbs[k] + other.limbs[k] + carry;
+            limbs[k] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    }
+
+    // requires |this| >= |other|
+    void subMagnitude(const FixedPoint& other) {
+        int64_t borrow = 0;
+        for (size_t k = 0; k < limbs.size(); k++) {
+            int64_t t = (int64_t)limbs[k] - other.limbs[k] - borrow;
+            borrow = t < 0;
+            limbs[k] = (uint32_t)(t + (borrow << 32));
+        }
+    }
+
+    // adds to the integer limb
+    void addSmall(uint32_t value) {
+        limbs.back() += value;
+    }
+
+    void mulSmall(uint32_t factor) {
+        uint64_t carry = 0;
+        for (size_t k = 0; k < limbs.size(); k++) {
+            uint64_t t = (uint64_t)limbs[k] * factor + carry;
+            limbs[k] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    }
+
+    void divSmall(uint32_t divisor) {
+        uint64_t rest = 0;
+        for (int k = (int)limbs.size() - 1; k >= 0; k--) {
+            uint64_t t = (rest << 32) | limbs[k];
+            limbs[k] = (uint32_t)(t / divisor);
+            rest = t % divisor;
+        }
+    }
+};
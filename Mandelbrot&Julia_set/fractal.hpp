@@ -0,0 +1,114 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Escape-time core without any SFML dependency, shared by the window app and the headless renderer.
+
+// Scalar type T is float, double or long double; the escape loops below run in T.
+template <typename T>
+struct BasicComplex {
+    T real;
+    T imag;
+
+    BasicComplex(T r = 0, T i = 0) : real(r), imag(i) {}
+
+    BasicComplex operator+(const BasicComplex& other) const {
+        return BasicComplex(real + other.real, imag + other.imag);
+    }
+
+    BasicComplex operator*(const BasicComplex& other) const {
+        return BasicComplex(real * other.real - imag * other.imag, real * other.imag + imag * other.real);
+    }
+
+    T magnitude() const {
+        return std::sqrt(real * real + imag * imag);
+    }
+};
+
+using Complex = BasicComplex<double>;
+
+// Number of iterations the loops below run for a point that never escapes.
+inline double iterationCap(double max_iter) {
+    return max_iter > 0 ? ceil(max_iter) : 0;
+}
+
+// a * b + c, fused where the target has hardware FMA; std::fma would be a slow library call without it.
+template <typename T>
+inline T mulAdd(T a, T b, T c) {
+#if defined(__FMA__) || defined(__aarch64__)
+    if (!std::is_same<T, long double>::value) {
+        return std::fma(a, b, c);
+    }
+#endif
+    return a * b + c;
+}
+
+// The escape loop: z = z * z + c while |z|^2 <= 4, at most iterationCap(max_iter) times.
+// The squares feed both the bailout test and the next z.
+template <typename T>
+inline double escapeTime(T zr, T zi, T cr, T ci, double max_iter) {
+    const long long limit = (long long)iterationCap(max_iter);
+    long long n = 0;
+    for (; n < limit; n++) {
+        T rr = zr * zr, ii = zi * zi;
+        if (rr + ii > 4) {
+            break;
+        }
+        zi = mulAdd(zr + zr, zi, ci);
+        zr = rr - ii + cr;
+    }
+    return (double)n;
+}
+
+// Smooth colouring lets points run on to this radius, where the fractional count below is continuous.
+const double smooth_bailout = 256;
+
+// Normalized escape count of a point whose |z|^2 = norm first passed smooth_bailout^2 after n iterations:
+// n + 1 - log2(log|z| / log R), in (n, n + 1] and continuous across the integer bands.
+inline double smoothCount(long long n, double norm) {
+    return (double)n + 1 - std::log2(std::log(norm) / std::log(smooth_bailout * smooth_bailout));
+}
+
+template <typename T>
+inline double mandelbrot(const BasicComplex<T>& c, double max_iter) {
+    return escapeTime<T>(0, 0, c.real, c.imag, max_iter);
+}
+
+template <typename T>
+inline double julia(BasicComplex<T> z, const BasicComplex<T>& c, double max_iter) {
+    return escapeTime<T>(z.real, z.imag, c.real, c.imag, max_iter);
+}
+
+struct Rgb {
+    uint8_t r, g, b;
+};
+
+// The original polynomial palette over t in [0, 1], black at both ends.
+inline Rgb classicColor(double t) {
+    int r = (int)(9*(1-t)*t*t*t*255);
+    int g = (int)(15*(1-t)*(1-t)*t*t*255);
+    int b =  (int)(8.5*(1-t)*(1-t)*(1-t)*t*255);
+
+    return {(uint8_t)r, (uint8_t)g, (uint8_t)b};
+}
+
+// Per-pixel evaluation of the classic palette; the app colours through a Palette table instead.
+// Takes the plain count or the smooth one; the polynomial is continuous in iter / max_iter.
+inline Rgb paletteColor(double iter, double max_iter) {
+    if (iter >= max_iter*0.9) {
+        return {0, 0, 0};
+    } else {
+        return classicColor(iter/max_iter);
+    }
+}
+
+// Points inside these two regions of the Mandelbrot set never escape, so they can skip the loop.
+inline bool inMainCardioid(double x, double y) {
+    double q = (x - 0.25) * (x - 0.25) + y * y;
+    return q * (q + (x - 0.25)) < 0.25 * y * y;
+}
+
+inline bool inPeriod2Bulb(double x, double y) {
+    return (x + 1) * (x + 1) + y * y < 0.0625;
+}
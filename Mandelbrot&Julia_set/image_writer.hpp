@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "fractal.hpp"
+
+// Writes an RGB image to disk one band of full-width rows at a time, top to bottom, so only the band
+// in flight is ever in memory. Every layout is known from the image size up front, so the file is
+// written strictly in order without seeking back.
+//
+// ppm:  binary P6, scanlines after the header.
+// raw:  the scanlines only, 3 bytes per pixel.
+// tiff: uncompressed tiles of tiff_tile x tiff_tile pixels. A band must hold whole rows of tiles,
+//       except for the last one, whose tiles are padded with black; any other band fails the write.
+//       Files past 4 GiB are BigTIFF.
+
+enum class ImageFormat { Ppm, Raw, Tiff };
+
+const int tiff_tile = 256;
+
+// By file extension; anything unknown is ppm.
+inline ImageFormat imageFormatFor(const std::string& path) {
+    auto endsWith = [&](const std::string& suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (endsWith(".tif") || endsWith(".tiff")) {
+        return ImageFormat::Tiff;
+    }
+    return endsWith(".raw") ? ImageFormat::Raw : ImageFormat::Ppm;
+}
+
+static_assert(sizeof(Rgb) == 3, "pixels are written as packed RGB");
+
+class ImageWriter {
+public:
+    ImageWriter(const std::string& path, ImageFormat format, int width, int height)
+        : format(format), width(width), height(height) {
+        file = fopen(path.c_str(), "wb");
+        ok = file != nullptr;
+        if (!ok) {
+            return;
+        }
+        if (format == ImageFormat::Ppm) {
+            ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+        } else if (format == ImageFormat::Tiff) {
+            writeTiffHeader();
+        }
+    }
+
+    ~ImageWriter() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    // The rows of the image below the ones written so far.
+    bool writeRows(const Rgb* pixels, int rows) {
+        if (!ok) {
+            return false;
+        }
+        if (format == ImageFormat::Tiff) {
+            writeTiles(pixels, rows);
+        } else {
+            size_t count = (size_t)width * rows;
+            ok = fwrite(pixels, sizeof(Rgb), count, file) == count;
+        }
+        rows_written += rows;
+        return ok;
+    }
+
+    // Completes the file; false if anything could not be written.
+    bool finish() {
+        if (ok && format == ImageFormat::Tiff) {
+            writeTiffDirectory();
+        }
+        ok = ok && rows_written == height;
+        if (file) {
+            ok = fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+        return ok;
+    }
+
+private:
+    FILE* file = nullptr;
+    ImageFormat format;
+    int width, height;
+    int rows_written = 0;
+    bool ok = false;
+
+    // TIFF layout: header, every tile in row-major order, then the directory and its arrays
+    bool big = false;
+    uint64_t tiles_x = 0, tiles_y = 0;
+    uint64_t data_start = 0;
+    std::vector<uint8_t> tile;
+
+    static constexpr uint64_t tile_bytes = (uint64_t)tiff_tile * tiff_tile * sizeof(Rgb);
+
+    void put(uint64_t value, int bytes) {
+        uint8_t data[8];
+        for (int k = 0; k < bytes; k++) {
+            data[k] = (uint8_t)(value >> (8 * k));
+        }
+        ok = ok && fwrite(data, 1, bytes, file) == (size_t)bytes;
+    }
+
+    uint64_t directoryStart() const {
+        return data_start + tiles_x * tiles_y * tile_bytes;
+    }
+
+    void writeTiffHeader() {
+        tiles_x = (width + tiff_tile - 1) / tiff_tile;
+        tiles_y = (height + tiff_tile - 1) / tiff_tile;
+        // the tile offsets and byte counts follow the tiles, so they count towards the 32-bit limit too
+        big = tiles_x * tiles_y * (tile_bytes + 8) + 4096 > UINT32_MAX;
+        data_start = big ? 16 : 8;
+
+        put(0x4949, 2); // "II", little-endian
+        if (big) {
+            put(43, 2);
+            put(8, 2); // offset size
+            put(0, 2);
+            put(directoryStart(), 8);
+        } else {
+            put(42, 2);
+            put(directoryStart(), 4);
+        }
+        tile.resize(tile_bytes);
+    }
+
+    void writeTiles(const Rgb* pixels, int rows) {
+        if (rows % tiff_tile != 0 && rows_written + rows != height) {
+            ok = false; // a partial row of tiles before the bottom of the image
+            return;
+        }
+        for (int y0 = 0; y0 < rows && ok; y0 += tiff_tile) {
+            const Rgb* strip = pixels + (size_t)y0 * width;
+            int strip_rows = std::min(tiff_tile, rows - y0);
+            for (uint64_t tx = 0; tx < tiles_x && ok; tx++) {
+                std::fill(tile.begin(), tile.end(), 0);
+                int x0 = (int)tx * tiff_tile, columns = std::min(tiff_tile, width - x0);
+                for (int j = 0; j < strip_rows; j++) {
+                    memcpy(&tile[(size_t)j * tiff_tile * sizeof(Rgb)], &strip[(size_t)j * width + x0],
+                           columns * sizeof(Rgb));
+                }
+                ok = fwrite(tile.data(), 1, tile.size(), file) == tile.size();
+            }
+        }
+    }
+
+    struct Entry {
+        uint16_t tag, type;
+        uint64_t count;
+        std::vector<uint8_t> data; // little-endian values
+    };
+
+    static Entry entry(uint16_t tag, uint16_t type, const std::vector<uint64_t>& values) {
+        int size = type == 3 ? 2 : type == 4 ? 4 : 8; // SHORT, LONG, LONG8
+        Entry e = {tag, type, values.size(), {}};
+        e.data.reserve(values.size() * size);
+        for (uint64_t value : values) {
+            for (int k = 0; k < size; k++) {
+                e.data.push_back((uint8_t)(value >> (8 * k)));
+            }
+        }
+        return e;
+    }
+
+    void writeTiffDirectory() {
+        uint64_t tiles = tiles_x * tiles_y;
+        std::vector<uint64_t> offsets(tiles), counts(tiles, tile_bytes);
+        for (uint64_t k = 0; k < tiles; k++) {
+            offsets[k] = data_start + k * tile_bytes;
+        }
+        std::vector<Entry> entries = {
+            entry(256, 4, {(uint64_t)width}),            // ImageWidth
+            entry(257, 4, {(uint64_t)height}),           // ImageLength
+            entry(258, 3, {8, 8, 8}),                    // BitsPerSample
+            entry(259, 3, {1}),                          // Compression: none
+            entry(262, 3, {2}),                          // PhotometricInterpretation: RGB
+            entry(277, 3, {3}),                          // SamplesPerPixel
+            entry(284, 3, {1}),                          // PlanarConfiguration: chunky
+            entry(322, 4, {(uint64_t)tiff_tile}),        // TileWidth
+            entry(323, 4, {(uint64_t)tiff_tile}),        // TileLength
+            entry(324, big ? 16 : 4, offsets),           // TileOffsets
+            entry(325, 4, counts),                       // TileByteCounts
+        };
+
+        // values that do not fit in the entry go after the directory, in entry order
+        int count_size = big ? 8 : 2, entry_size = big ? 20 : 12, offset_size = big ? 8 : 4;
+        uint64_t next = directoryStart() + count_size + entries.size() * entry_size + offset_size;
+        put(entries.size(), count_size);
+        for (const Entry& e : entries) {
+            put(e.tag, 2);
+            put(e.type, 2);
+            put(e.count, offset_size);
+            if (e.data.size() <= (size_t)offset_size) {
+                std::vector<uint8_t> inline_value(e.data);
+                inline_value.resize(offset_size, 0);
+                ok = ok && fwrite(inline_value.data(), 1, offset_size, file) == (size_t)offset_size;
+            } else {
+                put(next, offset_size);
+                next += e.data.size();
+            }
+        }
+        put(0, offset_size); // no further directory
+        for (const Entry& e : entries) {
+            if (e.data.size() > (size_t)offset_size) {
+                ok = ok && fwrite(e.data.data(), 1, e.data.size(), file) == e.data.size();
+            }
+        }
+    }
+};
@@ -2,7 +2,20 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <deque>
+#include <string>
+#include <sstream>
 #include "main.hpp"
+#include "thread_pool.hpp"
+#include "simd_kernels.hpp"
+#include "perturbation.hpp"
+#include "palette.hpp"
+#include "tile_cache.hpp"
 
 using namespace std;
 
@@ -10,21 +23,45 @@ using namespace std;
 
 class MandelbrotApp {
 public:
-    MandelbrotApp(double width, double height, double max_iter, char set_name):
+    MandelbrotApp(double width, double height, double max_iter, char set_name, unsigned threads = 0,
+                  const vector<Gradient>& loaded = {}, const string& tile_pack = ""):
         width(width), height(height), max_iter(max_iter),
-        x_min(-2.5), x_max(2.5), y_min(-2), y_max(2),
-        version(0), set_name(set_name) {
+        viewport{FixedPoint(-2.5), FixedPoint(-2.0), 5.0, 4.0},
+        set_name(set_name), pool(threads), simd_level(detectSimd()), gradients(builtinGradients()),
+        tile_store(tile_memory, tile_pack, kernel_version, tile_pack_bytes) {
 
         window.create(sf::VideoMode(width, height), "Mandelbrot Set");
-        image.create(width, height);
-        draw();
-        texture.loadFromImage(image);
+        window.setFramerateLimit(60);
+        gradients.insert(gradients.end(), loaded.begin(), loaded.end());
+        if (!tile_pack.empty()) {
+            tiled = true; // asking for a pack means asking for tiled frames
+            cout << "tiles: " << tile_store.packed() << " in " << tile_pack << '\n';
+        }
+        back_pixels.assign((size_t)width * height, 0);
+        ready_pixels.assign((size_t)width * height, 0);
+        iterations.assign((size_t)width * height, 0.0f);
+        texture.create(width, height);
+        texture.update(reinterpret_cast<const sf::Uint8*>(ready_pixels.data()));
         sprite.setTexture(texture);
+
+        render_thread = thread(&MandelbrotApp::renderLoop, this);
+        requestFrame();
+    }
+
+    ~MandelbrotApp() {
+        {
+            lock_guard<mutex> lock(job_mutex);
+            stopping = true;
+            generation++;
+        }
+        job_cv.notify_one();
+        render_thread.join();
     }
 
     void run() {
         while (window.isOpen()) {
             handleEvents();
+            presentFrame();
             render();
         }
     }
@@ -32,19 +69,104 @@ public:
 private:
     double width, height;
     char set_name;
-    double x_min, x_max, y_min, y_max;
     double max_iter;
-    int version;
-    vector<pair<double, double>> prev_x;
-    vector<pair<double, double>> prev_y;
+
+    struct Viewport {
+        FixedPoint x_min, y_min; // top-left corner; precision grows with the zoom depth
+        double span_x, span_y;
+    };
+    Viewport viewport;
+
+    // how the full-resolution pass covers the frame: every pixel, or only enough of them to fill the rest
+    enum FillMode { fill_all, fill_mariani_silver, fill_boundary_trace, fill_distance, fill_mode_count };
+
+    struct View {
+        Viewport viewport;
+        double max_iter;
+        int fill_mode = fill_all;
+        bool smooth = true; // fractional escape counts instead of integer bands
+        bool antialias = false;
+        bool tiles = false; // resampled from the tile store instead of computed pixel by pixel
+        bool attraction = false; // the heuristic interior test, see EscapeParams
+    };
+    vector<View> history; // max_iter is restored exactly so undo hits the frame cache
 
     sf::RenderWindow window;
-    sf::Image image;
     sf::Texture texture;
     sf::Sprite sprite;
     bool selecting = false;
     sf::Vector2i start_dot, end_dot;
 
+    ThreadPool pool; // threads = 0 -> hardware_concurrency
+    static const int tile_size = 32;
+    SimdLevel simd_level;
+    EscapeStats stats; // shortcut hit rates of the current frame
+
+    // background rendering: the UI thread posts views, the render thread posts finished frames
+    thread render_thread;
+    mutex job_mutex;
+    condition_variable job_cv;
+    View pending_view;
+    int pending_shift_x = 0, pending_shift_y = 0; // pan: new pixel (i, j) was pixel (i + shift) of pending_base
+    string pending_base;                          // key of the view the pan started from
+    bool pending_recolor = false;                 // only the colours changed
+    bool job_pending = false;
+    bool stopping = false;
+    atomic<unsigned> generation{0}; // bumped by every request, cancels the frame in flight
+
+    // owned by the render thread: the compute pass fills iterations, the colorize pass maps it to back_pixels
+    vector<float> iterations;
+    vector<uint8_t> known; // pixels of the current frame that were computed rather than filled
+    vector<float> distances; // fill_distance: estimated distance to the set per pixel, -1 where not estimated
+    string iterations_key; // view of the iteration buffer once it is complete
+    vector<int> aa_slot;     // per pixel: its block of supersample counts in aa_counts, or -1; empty without AA
+    vector<float> aa_counts; // aa_samples counts per supersampled pixel
+    vector<uint32_t> back_pixels; // row-major packed RGBA, handed to the texture without an sf::Image
+    Palette palette;              // rebuilt by colorize when the gradient or the colour range changes
+
+    // complete iteration buffers (and their supersamples) by view, oldest evicted first
+    struct CachedFrame {
+        vector<float> iterations;
+        vector<int> aa_slot;
+        vector<float> aa_counts;
+    };
+    map<string, CachedFrame> frame_cache;
+    deque<string> cache_order;
+    static const size_t frame_cache_size = 16;
+
+    mutex frame_mutex;
+    vector<uint32_t> ready_pixels; // last posted frame, guarded by frame_mutex
+    bool frame_ready = false;
+
+    static const int pan_step = 128; // pixels per arrow key
+    atomic<bool> progressive{true}; // P toggles; coarse 1/8 -> 1/4 -> 1/2 -> full passes
+    static const int coarse_step = 8;
+    atomic<double> color_scale{1.0}; // C cycles; colours are spread over color_scale * max_iter (or * period)
+    vector<Gradient> gradients;      // built-ins, then the files given on the command line
+    atomic<int> gradient{0};         // G cycles
+
+    atomic<int> fill_mode{fill_all}; // M cycles
+    atomic<bool> smooth{true};       // S toggles
+    atomic<bool> attraction{false};  // I toggles
+    static const int subdivide_tile = 128;
+    atomic<long long> filled{0}; // pixels of the frame that were filled instead of computed
+    atomic<long long> outlined{0}; // escaped pixels drawn as the set because it passes within half a pixel
+
+    // adaptive anti-aliasing: only pixels on an edge get aa_grid x aa_grid samples
+    atomic<bool> antialias{false}; // A toggles
+    static const int aa_grid = 4;
+    static const int aa_samples = aa_grid * aa_grid;
+    static const int aa_contrast = 12;         // colour difference to a neighbour (0..255 per channel) that makes an edge
+    long long supersampled = 0;                // edge pixels of the frame, with one sample per quadrant
+    long long fully_supersampled = 0;          // the ones among them that got all aa_samples
+
+    // tiles of iteration counts that outlive the frames they were computed for, see tile_cache.hpp
+    atomic<bool> tiled{false}; // T toggles
+    static const size_t tile_memory = 4096; // 64 MiB of tiles
+    static const uint64_t tile_pack_bytes = 1ull << 30; // the pack stops growing at 1 GiB
+    static const int preview_levels = 4;    // ancestors up to 16x coarser stand in for missing tiles
+    TileStore tile_store;
+
     void handleEvents() {
         sf::Event event;
         while (window.pollEvent(event)) {
@@ -52,22 +174,61 @@ private:
                 window.close();
             }
 
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::P) {
+                progressive = !progressive;
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::S) {
+                smooth = !smooth;
+                requestFrame();
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::A) {
+                // same one-sample buffer either way, so the current frame is the base of the new one
+                string base = frameKey({viewport, max_iter, fill_mode, smooth, antialias, tiled, attraction});
+                antialias = !antialias;
+                queueJob(0, 0, base, false);
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::T) {
+                tiled = !tiled;
+                requestFrame();
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::I) {
+                attraction = !attraction;
+                requestFrame();
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::M) {
+                fill_mode = (fill_mode + 1) % fill_mode_count;
+                requestFrame();
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::C) {
+                color_scale = color_scale > 0.3 ? color_scale / 2 : 1.0;
+                queueJob(0, 0, "", true);
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::G) {
+                gradient = (gradient + 1) % (int)gradients.size();
+                cout << "palette: " << gradients[gradient].name << '\n';
+                queueJob(0, 0, "", true);
+            }
+
             if (event.type == sf::Event::KeyPressed) {
-                if (event.key.code == sf::Keyboard::Space && version > 0) {
-                    if (prev_x.size() > 0 && prev_y.size() > 0) {
-                        x_min = prev_x[--version].first;
-                        x_max = prev_x[version].second;
-                        y_min = prev_y[version].first;
-                        y_max = prev_y[version].second;
-
-                        prev_x.pop_back();
-                        prev_y.pop_back();
-
-                        max_iter /= 1.2;
-                        draw();
-                        texture.loadFromImage(image);
-                    }
+                if (event.key.code == sf::Keyboard::Space && !history.empty()) {
+                    viewport = history.back().viewport;
+                    max_iter = history.back().max_iter;
+                    history.pop_back();
+
+                    requestFrame();
                 }
+
+                if (event.key.code == sf::Keyboard::Left) pan(-pan_step, 0);
+                if (event.key.code == sf::Keyboard::Right) pan(pan_step, 0);
+                if (event.key.code == sf::Keyboard::Up) pan(0, -pan_step);
+                if (event.key.code == sf::Keyboard::Down) pan(0, pan_step);
             }
 
             if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
@@ -84,6 +245,7 @@ private:
 
             if (event.type == sf::Event::MouseButtonReleased && selecting) {
                 selecting = false;
+                history.push_back({viewport, max_iter});
                 max_iter *= 1.2;
                 // cout << 3 << '\n';
                 processSelection();
@@ -115,24 +277,890 @@ private:
         window.display();
     }
 
-    void draw() {
-        for (int i = 0; i < width; i++) {
-            for (int j = 0; j < height; j++) {
-                double x = x_min + (x_max - x_min) * i / width;
-                double y = y_min + (y_max - y_min) * j / height;
-                Complex z(x, y);
-                if (set_name == 'j') {
-                    x = -0.7;
-                    y = 0.27015;
+    string frameKey(const View& view) const {
+        ostringstream key;
+        key.precision(17);
+        key << set_name << ' ' << view.max_iter << ' ' << view.viewport.span_x << ' ' << view.viewport.span_y << ' '
+            << view.viewport.x_min.toString(view.viewport.x_min.fracLimbs() * 10) << ' '
+            << view.viewport.y_min.toString(view.viewport.y_min.fracLimbs() * 10);
+        if (view.tiles) {
+            key << " tiles"; // resampled frames may differ from the exact one, and take no fill mode
+        } else if (view.fill_mode != fill_all) {
+            key << " fill " << view.fill_mode; // filled frames may differ from the exact one
+        }
+        key << (view.smooth ? " smooth" : "") << (view.antialias ? " aa" : "");
+        key << (view.attraction ? " attraction" : "");
+        return key.str();
+    }
+
+    void requestFrame() {
+        queueJob(0, 0, "", false);
+    }
+
+    void queueJob(int shift_x, int shift_y, const string& base, bool recolor) {
+        {
+            lock_guard<mutex> lock(job_mutex);
+            pending_view = {viewport, max_iter, fill_mode, smooth, antialias, tiled, attraction};
+            pending_shift_x = shift_x;
+            pending_shift_y = shift_y;
+            pending_base = base;
+            pending_recolor = recolor;
+            job_pending = true;
+            generation++;
+        }
+        job_cv.notify_one();
+    }
+
+    // Moves the view by whole pixels so the last complete iteration buffer can be shifted.
+    void pan(int dx, int dy) {
+        string base = frameKey({viewport, max_iter, fill_mode, smooth, antialias, tiled, attraction});
+        history.push_back({viewport, max_iter});
+
+        int frac = viewport.x_min.fracLimbs();
+        viewport.x_min = viewport.x_min + FixedPoint(viewport.span_x * dx / width, frac);
+        viewport.y_min = viewport.y_min + FixedPoint(viewport.span_y * dy / height, frac);
+        queueJob(dx, dy, base, false);
+    }
+
+    void renderLoop() {
+        while (true) {
+            View view;
+            unsigned gen;
+            int shift_x, shift_y;
+            string base;
+            bool recolor;
+            {
+                unique_lock<mutex> lock(job_mutex);
+                job_cv.wait(lock, [this] { return job_pending || stopping; });
+                if (stopping) {
+                    return;
+                }
+                view = pending_view;
+                shift_x = pending_shift_x;
+                shift_y = pending_shift_y;
+                base = pending_base;
+                recolor = pending_recolor;
+                gen = generation;
+                job_pending = false;
+            }
+
+            string key = frameKey(view);
+            if (recolor && iterations_key == key) {
+                colorize(view);
+                postFrame();
+                continue;
+            }
+            auto cached = frame_cache.find(key);
+            if (cached != frame_cache.end()) {
+                iterations = cached->second.iterations;
+                aa_slot = cached->second.aa_slot;
+                aa_counts = cached->second.aa_counts;
+                iterations_key = key;
+                colorize(view);
+                postFrame();
+                continue;
+            }
+            bool shifted = !base.empty() && iterations_key == base;
+            iterations_key.clear();
+            if (draw(view, gen, shifted ? shift_x : 0, shifted ? shift_y : 0, shifted)) {
+                iterations_key = key;
+                frame_cache[key] = {iterations, aa_slot, aa_counts};
+                cache_order.push_back(key);
+                if (cache_order.size() > frame_cache_size) {
+                    frame_cache.erase(cache_order.front());
+                    cache_order.pop_front();
+                }
+            }
+        }
+    }
+
+    void postFrame() {
+        lock_guard<mutex> lock(frame_mutex);
+        ready_pixels.swap(back_pixels); // colorize rewrites every pixel of the old buffer
+        frame_ready = true;
+    }
+
+    void presentFrame() {
+        lock_guard<mutex> lock(frame_mutex);
+        if (frame_ready) {
+            texture.update(reinterpret_cast<const sf::Uint8*>(ready_pixels.data()));
+            frame_ready = false;
+        }
+    }
+
+    // Maps the iteration buffer to colours; runs again on its own when only the palette changes.
+    // One task per row, so every thread writes its own contiguous run of cache lines.
+    void colorize(const View& view) {
+        int w = (int)width, h = (int)height;
+        palette.build(gradients[gradient], view.max_iter, color_scale);
+        pool.parallelFor(h, [&](int j) {
+            uint32_t* row = &back_pixels[(size_t)j * w];
+            palette.colorize(&iterations[(size_t)j * w], w, row);
+            if (aa_slot.empty()) {
+                return;
+            }
+            for (int i = 0; i < w; i++) {
+                int slot = aa_slot[(size_t)j * w + i];
+                if (slot >= 0) {
+                    row[i] = palette.average(&aa_counts[(size_t)slot * aa_samples], aa_samples);
+                }
+            }
+        });
+    }
+
+    // Returns false if a newer request cancelled the frame before it was finished.
+    // Every pass is colorized and posted as soon as it is done. With shift set the view was panned by
+    // (shift_x, shift_y) pixels: the iteration buffer is shifted and only the exposed strips are computed.
+    bool draw(const View& view, unsigned gen, int shift_x, int shift_y, bool shift) {
+        const Viewport& port = view.viewport;
+        EscapeParams params = {set_name == 'j', -0.7, 0.27015, view.max_iter};
+        params.smooth = view.smooth;
+        params.attraction = view.attraction;
+        params.origin_re = port.x_min.toDoubleDouble();
+        params.origin_im = port.y_min.toDoubleDouble();
+
+        // the cheapest scalar that resolves the pixels; past double, perturbation around the centre of the view
+        double spacing = std::min(port.span_x / width, port.span_y / height);
+        double x_min = (double)params.origin_re, y_min = (double)params.origin_im;
+        double scale = std::max({std::fabs(x_min), std::fabs(x_min + port.span_x), std::fabs(y_min),
+                                 std::fabs(y_min + port.span_y)});
+        params.precision = selectPrecision(spacing, scale, view.max_iter);
+        bool deep = !precisionFits(params.precision, spacing, scale);
+        // the tile grid is finer than the pixels and anchored at 0, so it needs double to spare
+        bool tiles = view.tiles && !deep && precisionFits(Precision::Double, tileSpacing(tileLevel(spacing)), scale);
+        ReferenceOrbit orbit;
+        SeriesApproximation series;
+        if (deep) {
+            FixedPoint ref_x = port.x_min + FixedPoint(port.span_x / 2, port.x_min.fracLimbs());
+            FixedPoint ref_y = port.y_min + FixedPoint(port.span_y / 2, port.y_min.fracLimbs());
+            orbit = referenceOrbit(ref_x, ref_y, params);
+            series = seriesApproximation(orbit, params, port.span_x / 2, port.span_y / 2, spacing);
+        }
+
+        stats.reset();
+        filled = 0;
+        outlined = 0;
+        supersampled = 0;
+        fully_supersampled = 0;
+        Pass pass = {view, params, deep ? &orbit : nullptr, &series, gen};
+        int w = (int)width, h = (int)height;
+        iterations.resize((size_t)w * h);
+        known.assign((size_t)w * h, 0);
+        // perturbation carries no derivative, so deep frames compute every pixel instead
+        bool distance = view.fill_mode == fill_distance && !deep && !tiles;
+        if (distance) {
+            distances.assign((size_t)w * h, -1.0f);
+        }
+
+        if (!shift || !view.antialias || tiles) {
+            aa_slot.clear();
+            aa_counts.clear();
+        }
+
+        TileReport tile_report;
+        if (tiles) {
+            if (!drawTiles(pass, tile_report)) {
+                return false;
+            }
+        } else if (shift) {
+            // supersamples move with their pixels; the blocks of pixels that left the frame are dropped
+            vector<float> shifted(iterations.size(), 0.0f);
+            vector<int> shifted_slot(aa_slot.empty() ? 0 : iterations.size(), -1);
+            vector<float> shifted_counts;
+            for (int j = 0; j < h; j++) {
+                for (int i = 0; i < w; i++) {
+                    int si = i + shift_x, sj = j + shift_y;
+                    if (si >= 0 && si < w && sj >= 0 && sj < h) {
+                        size_t from = (size_t)sj * w + si, to = (size_t)j * w + i;
+                        shifted[to] = iterations[from];
+                        if (!aa_slot.empty() && aa_slot[from] >= 0) {
+                            shifted_slot[to] = (int)(shifted_counts.size() / aa_samples);
+                            const float* block = &aa_counts[(size_t)aa_slot[from] * aa_samples];
+                            shifted_counts.insert(shifted_counts.end(), block, block + aa_samples);
+                        }
+                    }
+                }
+            }
+            iterations.swap(shifted);
+            aa_slot.swap(shifted_slot);
+            aa_counts.swap(shifted_counts);
+            // exposed rows across the full width, then exposed columns over the remaining rows
+            Rect rows = shift_y >= 0 ? Rect{0, std::max(0, h - shift_y), w, h} : Rect{0, 0, w, std::min(h, -shift_y)};
+            Rect cols = shift_x >= 0 ? Rect{std::max(0, w - shift_x), 0, w, h} : Rect{0, 0, std::min(w, -shift_x), h};
+            cols.y0 = shift_y >= 0 ? 0 : rows.y1;
+            cols.y1 = shift_y >= 0 ? rows.y0 : h;
+            drawPass(pass, 1, false, rows);
+            drawPass(pass, 1, false, cols);
+        } else {
+            bool passes = progressive;
+            for (int step = passes ? coarse_step : 1; step > 1; step /= 2) {
+                drawPass(pass, step, passes && step < coarse_step);
+                if (generation != gen) {
+                    return false;
+                }
+                colorize(view);
+                postFrame();
+            }
+            if (view.fill_mode == fill_all || (view.fill_mode == fill_distance && !distance)) {
+                drawPass(pass, 1, passes);
+            } else {
+                subdivide(pass, view.fill_mode);
+            }
+        }
+        if (view.antialias && generation == gen) {
+            // the edges are colorized in one sample per pixel first, then refined
+            colorize(view);
+            postFrame();
+            supersample(pass);
+        }
+        if (generation != gen) {
+            return false;
+        }
+        colorize(view);
+        postFrame();
+
+        cout << (shift_x || shift_y ? "pan: " : shift ? "reused: " : "frame: ");
+        if (deep) {
+            cout << "perturbation, " << port.x_min.fracLimbs() * 32 << "-bit reference orbit of "
+                 << orbit.re.size() << ", series skips " << series.skip << " iterations (error bound "
+                 << series.error_bound << "), ";
+        } else {
+            cout << precisionName(params.precision) << ", ";
+        }
+        if (tiles) {
+            cout << "tiles of level " << tile_report.level << ": " << tile_report.cached << " cached ("
+                 << tile_report.from_disk << " from the pack), " << tile_report.assembled << " from children, "
+                 << tile_report.computed << " computed (" << tile_report.raised << " from a smaller max_iter), ";
+        }
+        if (filled > 0) {
+            cout << "filled " << 100.0 * filled / (w * h) << "%, ";
+        }
+        if (outlined > 0) {
+            cout << "outlined " << 100.0 * outlined / (w * h) << "%, ";
+        }
+        if (supersampled > 0) {
+            cout << "supersampled " << 100.0 * supersampled / (w * h) << "% x4, "
+                 << 100.0 * fully_supersampled / (w * h) << "% x" << aa_samples << ", ";
+        }
+        stats.report(cout);
+        return true;
+    }
+
+    struct Rect {
+        int x0, y0, x1, y1;
+    };
+
+    // Everything a pass needs to turn pixel (i, j) into an iteration count.
+    // Point coordinates are offsets from the top-left corner (params.origin), or with an orbit
+    // from the reference point in the middle of the view.
+    struct Pass {
+        const View& view;
+        const EscapeParams& params;
+        const ReferenceOrbit* orbit;
+        const SeriesApproximation* series;
+        unsigned gen;
+    };
+
+    // Pixel coordinates may be fractional for supersamples inside the pixel.
+    double pointX(const Pass& pass, double i) const {
+        const Viewport& port = pass.view.viewport;
+        return pass.orbit ? port.span_x * i / width - port.span_x / 2 : port.span_x * i / width;
+    }
+
+    double pointY(const Pass& pass, double j) const {
+        const Viewport& port = pass.view.viewport;
+        return pass.orbit ? port.span_y * j / height - port.span_y / 2 : port.span_y * j / height;
+    }
+
+    void computeRow(const Pass& pass, const double* xs, double y, int count, double* out) {
+        if (pass.orbit) {
+            perturbRow(*pass.orbit, pass.series, xs, y, count, pass.params, out, &stats);
+        } else {
+            escapeRow(simd_level, xs, y, count, pass.params, out, &stats);
+        }
+    }
+
+    // Samples every step-th pixel of the area and fills the step x step block below-right of it.
+    // With reuse set, samples already taken by the previous (2 * step) pass are skipped.
+    void drawPass(const Pass& pass, int step, bool reuse, Rect area = {0, 0, -1, -1}) {
+        if (area.x1 < 0) {
+            area = {0, 0, (int)width, (int)height};
+        }
+        if (area.x0 >= area.x1 || area.y0 >= area.y1) {
+            return;
+        }
+        // small tiles so boundary-heavy tiles get spread over the pool by stealing
+        int tiles_x = (area.x1 - area.x0 + tile_size - 1) / tile_size;
+        int tiles_y = (area.y1 - area.y0 + tile_size - 1) / tile_size;
+
+        pool.parallelFor(tiles_x * tiles_y, [&](int tile) {
+            if (generation != pass.gen) {
+                return;
+            }
+            int i_begin = area.x0 + (tile % tiles_x) * tile_size;
+            int j_begin = area.y0 + (tile / tiles_x) * tile_size;
+            int i_end = std::min(i_begin + tile_size, area.x1);
+            int j_end = std::min(j_begin + tile_size, area.y1);
+
+            int cols[tile_size];
+            double xs[tile_size], iters[tile_size];
+
+            for (int j = j_begin; j < j_end; j += step) {
+                // on rows the previous pass sampled, only the odd multiples of step are new
+                bool old_row = reuse && j % (2 * step) == 0;
+                int first = old_row ? i_begin + step : i_begin;
+                int stride = old_row ? 2 * step : step;
+
+                int count = 0;
+                for (int i = first; i < i_end; i += stride) {
+                    cols[count] = i;
+                    xs[count++] = pointX(pass, i);
+                }
+                if (count == 0) {
+                    continue;
+                }
+                computeRow(pass, xs, pointY(pass, j), count, iters);
+
+                for (int k = 0; k < count; k++) {
+                    known[(size_t)j * (int)width + cols[k]] = 1;
+                    for (int bj = j; bj < std::min(j + step, j_end); bj++) {
+                        for (int bi = cols[k]; bi < std::min(cols[k] + step, i_end); bi++) {
+                            iterations[(size_t)bj * (int)width + bi] = (float)iters[k];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    struct TileReport {
+        int level = 0;
+        int cached = 0, from_disk = 0, assembled = 0, computed = 0, raised = 0;
+    };
+
+    // Resamples the frame from the tiles of the coarsest level at least as fine as its pixels, every
+    // pixel taking the nearest sample. A tile comes from the store, from its four children, or is
+    // computed on top of the samples it or its parent already holds (see sampleKnown()); while the
+    // missing tiles are computed, ancestors still in memory stand in for them.
+    bool drawTiles(const Pass& pass, TileReport& report) {
+        const Viewport& port = pass.view.viewport;
+        int w = (int)width, h = (int)height;
+        int level = tileLevel(std::min(port.span_x / width, port.span_y / height));
+        double s = tileSpacing(level);
+        report.level = level;
+
+        // grid index of the sample nearest to each pixel column and row
+        double x_min = port.x_min.toDouble(), y_min = port.y_min.toDouble();
+        vector<int64_t> gx(w), gy(h);
+        for (int i = 0; i < w; i++) {
+            gx[i] = (int64_t)std::floor((x_min + port.span_x * i / width) / s + 0.5);
+        }
+        for (int j = 0; j < h; j++) {
+            gy[j] = (int64_t)std::floor((y_min + port.span_y * j / height) / s + 0.5);
+        }
+        int64_t tx0 = floorDiv(gx.front(), tile_side), ty0 = floorDiv(gy.front(), tile_side);
+        int tiles_x = (int)(floorDiv(gx.back(), tile_side) - tx0 + 1);
+        int tiles_y = (int)(floorDiv(gy.back(), tile_side) - ty0 + 1);
+
+        // one precision for the whole level, so neighbouring tiles cannot differ by rounding
+        EscapeParams params = pass.params;
+        params.precision = selectPrecision(s, 2.0, pass.view.max_iter);
+        ostringstream formula;
+        formula.precision(17);
+        formula << (params.julia ? "julia " : "mandelbrot");
+        if (params.julia) {
+            formula << params.c_re << ' ' << params.c_im;
+        }
+        formula << (params.smooth ? " smooth" : "") << (params.attraction ? " attraction" : "");
+
+        const double max_iter = pass.view.max_iter;
+        vector<TileKey> keys;
+        vector<Tile> found(tiles_x * tiles_y), stale(tiles_x * tiles_y); // stale: computed with less max_iter
+        vector<int> missing;
+        for (int t = 0; t < tiles_x * tiles_y; t++) {
+            keys.push_back({level, tx0 + t % tiles_x, ty0 + t / tiles_x, formula.str()});
+            bool from_disk = false;
+            found[t] = tile_store.find(keys[t], &from_disk);
+            if (found[t] && found[t].max_iter >= max_iter) {
+                report.cached++;
+                report.from_disk += from_disk;
+                continue;
+            }
+            stale[t] = found[t];
+            found[t] = Tile();
+            Tile children[4];
+            bool complete = true;
+            for (int k = 0; k < 4 && complete; k++) {
+                children[k] = tile_store.find(keys[t].child(k));
+                complete = children[k] && children[k].max_iter >= max_iter;
+            }
+            if (complete) {
+                found[t] = decimateChildren(children);
+                tile_store.insert(keys[t], found[t]);
+                report.assembled++;
+            } else {
+                missing.push_back(t);
+            }
+        }
+
+        // source[t] is tile t or its ancestor depth[t] levels up; pixels without a source are 0, and
+        // counts from tiles computed with a larger max_iter are capped at this one
+        float cap = (float)iterationCap(max_iter);
+        auto resample = [&](const vector<Tile>& source, const vector<int>& depth) {
+            pool.parallelFor(h, [&](int j) {
+                for (int i = 0; i < w; i++) {
+                    size_t t = (size_t)(floorDiv(gy[j], tile_side) - ty0) * tiles_x + (floorDiv(gx[i], tile_side) - tx0);
+                    float value = 0.0f;
+                    if (source[t]) {
+                        int64_t ax = floorDiv(gx[i], (int64_t)1 << depth[t]), ay = floorDiv(gy[j], (int64_t)1 << depth[t]);
+                        int64_t x = ax - floorDiv(ax, tile_side) * tile_side, y = ay - floorDiv(ay, tile_side) * tile_side;
+                        value = std::min(source[t].get()[y * tile_side + x], cap);
+                    }
+                    iterations[(size_t)j * w + i] = value;
+                }
+            });
+        };
+
+        if (!missing.empty() && progressive) {
+            vector<Tile> preview(found);
+            vector<int> depth(found.size(), 0);
+            for (int t : missing) {
+                preview[t] = stale[t]; // the tile itself before its max_iter was raised, if it is there
+                TileKey ancestor = keys[t];
+                for (int d = 1; d <= preview_levels && !preview[t]; d++) {
+                    ancestor = ancestor.parent();
+                    preview[t] = tile_store.peek(ancestor);
+                    depth[t] = d;
+                }
+            }
+            resample(preview, depth);
+            colorize(pass.view);
+            postFrame();
+        }
+
+        pool.parallelFor((int)missing.size(), [&](int m) {
+            if (generation != pass.gen) {
+                return;
+            }
+            int t = missing[m];
+            found[t] = computeTile(keys[t], params, s, max_iter, stale[t]);
+            tile_store.insert(keys[t], found[t]);
+        });
+        if (generation != pass.gen) {
+            return false;
+        }
+        report.computed = (int)missing.size();
+        for (int t : missing) {
+            report.raised += stale[t] ? 1 : 0;
+        }
+        resample(found, vector<int>(found.size(), 0));
+        return true;
+    }
+
+    // The samples of one tile, one kernel call per row; those that stale (the tile computed with a
+    // smaller max_iter, if any) or its parent holds exactly are copied instead.
+    Tile computeTile(const TileKey& key, EscapeParams params, double s, double max_iter, const Tile& stale) {
+        vector<float> counts(tile_samples);
+        vector<uint8_t> have(tile_samples, 0);
+        Tile parent = tile_store.find(key.parent());
+        if (parent) {
+            inheritSamples(key, parent, true, max_iter, counts, have);
+        }
+        if (stale) {
+            inheritSamples(key, stale, false, max_iter, counts, have);
+        }
+        // the tile corner, exact in double for every level that passes the precision test
+        params.origin_re = std::ldexp((double)key.tx, -key.level);
+        params.origin_im = std::ldexp((double)key.ty, -key.level);
+        int at[tile_side];
+        double xs[tile_side], ys[tile_side], iters[tile_side];
+        for (int y = 0; y < tile_side; y++) {
+            int count = 0;
+            for (int x = 0; x < tile_side; x++) {
+                if (!have[y * tile_side + x]) {
+                    at[count] = x;
+                    xs[count] = x * s;
+                    ys[count++] = y * s;
+                }
+            }
+            escapePoints(simd_level, xs, ys, count, params, iters, &stats);
+            for (int k = 0; k < count; k++) {
+                counts[y * tile_side + at[k]] = (float)iters[k];
+            }
+        }
+        return makeTile(std::move(counts), max_iter);
+    }
+
+    void computePoints(const Pass& pass, const double* xs, const double* ys, int count, double* out) {
+        if (pass.orbit) {
+            perturbPoints(*pass.orbit, pass.series, xs, ys, count, pass.params, out, &stats);
+        } else {
+            escapePoints(simd_level, xs, ys, count, pass.params, out, &stats);
+        }
+    }
+
+    // Computes the listed pixels (row-major indices) that are not known yet, 32 per kernel call,
+    // so scattered pixels such as rectangle borders still fill the SIMD lanes. With distance, the ones
+    // that escaped also get their estimate in distances; being slower, the distance kernel only runs
+    // for those, after the plain one has sorted out the interior (no perturbation).
+    void computePixels(const Pass& pass, const int* pixels, int count, bool distance = false) {
+        const int chunk = 32;
+        int w = (int)width;
+        float interior = (float)iterationCap(pass.view.max_iter);
+        int at[chunk];
+        double xs[chunk], ys[chunk], iters[chunk], estimates[chunk];
+
+        for (int round = 0; round < (distance ? 2 : 1); round++) {
+            for (int k = 0; k < count;) {
+                int size = 0;
+                for (; k < count && size < chunk; k++) {
+                    int pixel = pixels[k];
+                    if (round == 1 && known[pixel] && distances[pixel] < 0 && iterations[pixel] == interior) {
+                        distances[pixel] = 0;
+                    } else if (round == 0 ? !known[pixel] : distances[pixel] < 0) {
+                        at[size] = pixel;
+                        xs[size] = pointX(pass, pixel % w);
+                        ys[size++] = pointY(pass, pixel / w);
+                    }
+                }
+                if (size == 0) {
+                    continue;
+                }
+                if (round == 1) {
+                    escapePoints(simd_level, xs, ys, size, pass.params, iters, nullptr, estimates);
+                } else {
+                    computePoints(pass, xs, ys, size, iters);
+                }
+                for (int r = 0; r < size; r++) {
+                    iterations[at[r]] = (float)iters[r];
+                    known[at[r]] = 1;
+                    if (round == 1) {
+                        distances[at[r]] = (float)estimates[r];
+                    }
+                }
+            }
+        }
+    }
+
+    // Runs Mariani-Silver, boundary tracing or distance filling on independent tiles of the whole frame.
+    void subdivide(const Pass& pass, int fill_mode) {
+        int tiles_x = ((int)width + subdivide_tile - 1) / subdivide_tile;
+        int tiles_y = ((int)height + subdivide_tile - 1) / subdivide_tile;
+
+        pool.parallelFor(tiles_x * tiles_y, [&](int tile) {
+            if (generation != pass.gen) {
+                return;
+            }
+            int x0 = (tile % tiles_x) * subdivide_tile, y0 = (tile / tiles_x) * subdivide_tile;
+            Rect area = {x0, y0, std::min(x0 + subdivide_tile, (int)width), std::min(y0 + subdivide_tile, (int)height)};
+            if (fill_mode == fill_mariani_silver) {
+                marianiSilver(pass, area);
+            } else if (fill_mode == fill_boundary_trace) {
+                boundaryTrace(pass, area);
+            } else {
+                distanceFill(pass, area);
+            }
+        });
+    }
+
+    // Computes the border of the rectangle; if every border pixel has the same count the inside
+    // is filled with it, otherwise the rectangle is split in four.
+    void marianiSilver(const Pass& pass, Rect r) {
+        int w = (int)width;
+        if (r.x1 - r.x0 <= 4 || r.y1 - r.y0 <= 4) {
+            vector<int> pixels;
+            for (int j = r.y0; j < r.y1; j++) {
+                for (int i = r.x0; i < r.x1; i++) {
+                    pixels.push_back(j * w + i);
                 }
+            }
+            computePixels(pass, pixels.data(), (int)pixels.size());
+            return;
+        }
+        if (fillUniform(pass, r)) {
+            return;
+        }
 
-                Complex c(x, y);
+        int mx = (r.x0 + r.x1) / 2, my = (r.y0 + r.y1) / 2;
+        marianiSilver(pass, {r.x0, r.y0, mx, my});
+        marianiSilver(pass, {mx, r.y0, r.x1, my});
+        marianiSilver(pass, {r.x0, my, mx, r.y1});
+        marianiSilver(pass, {mx, my, r.x1, r.y1});
+    }
 
-                double iter = set_name == 'm' ? mandelbrot(c, max_iter) : julia(z, c, max_iter);
-                sf::Color color = getColor(iter, max_iter);
-                image.setPixel(i, j, color);
+    // The Mariani-Silver test: computes the border and fills the inside if the border is uniform.
+    bool fillUniform(const Pass& pass, Rect r) {
+        int w = (int)width;
+        vector<int> border;
+        for (int i = r.x0; i < r.x1; i++) {
+            border.push_back(r.y0 * w + i);
+            border.push_back((r.y1 - 1) * w + i);
+        }
+        for (int j = r.y0 + 1; j < r.y1 - 1; j++) {
+            border.push_back(j * w + r.x0);
+            border.push_back(j * w + r.x1 - 1);
+        }
+        computePixels(pass, border.data(), (int)border.size());
+
+        float value = iterations[border[0]];
+        bool uniform = std::all_of(border.begin(), border.end(), [&](int at) { return iterations[at] == value; });
+        if (uniform) {
+            long long count = 0;
+            for (int j = r.y0 + 1; j < r.y1 - 1; j++) {
+                for (int i = r.x0 + 1; i < r.x1 - 1; i++) {
+                    size_t at = (size_t)j * w + i;
+                    if (!known[at]) {
+                        iterations[at] = value;
+                        count++;
+                    }
+                }
             }
+            filled += count;
         }
+        return uniform;
+    }
+
+    // Starting from the tile border, every pixel that escaped brings in its 8 neighbours, one
+    // wavefront per kernel batch, so the computed pixels flood the exterior and stop at the edge of
+    // the interior. Whatever is never reached is enclosed by interior pixels, and since the filled-in
+    // Mandelbrot and Julia sets have no holes it is interior as well; the only misses are exterior
+    // filaments that pass between two samples without touching one.
+    void boundaryTrace(const Pass& pass, Rect r) {
+        int w = (int)width, rw = r.x1 - r.x0;
+        float interior = (float)iterationCap(pass.view.max_iter);
+        vector<uint8_t> queued((size_t)rw * (r.y1 - r.y0), 0);
+        vector<int> front, next;
+
+        auto push = [&](vector<int>& queue, int i, int j) {
+            if (i < r.x0 || i >= r.x1 || j < r.y0 || j >= r.y1) {
+                return;
+            }
+            uint8_t& mark = queued[(size_t)(j - r.y0) * rw + (i - r.x0)];
+            if (!mark) {
+                mark = 1;
+                queue.push_back(j * w + i);
+            }
+        };
+        for (int i = r.x0; i < r.x1; i++) {
+            push(front, i, r.y0);
+            push(front, i, r.y1 - 1);
+        }
+        for (int j = r.y0; j < r.y1; j++) {
+            push(front, r.x0, j);
+            push(front, r.x1 - 1, j);
+        }
+
+        while (!front.empty()) {
+            computePixels(pass, front.data(), (int)front.size());
+            next.clear();
+            for (int at : front) {
+                if (iterations[at] != interior) {
+                    int i = at % w, j = at / w;
+                    for (int dj = -1; dj <= 1; dj++) {
+                        for (int di = -1; di <= 1; di++) {
+                            push(next, i + di, j + dj);
+                        }
+                    }
+                }
+            }
+            front.swap(next);
+        }
+
+        long long count = 0;
+        for (int j = r.y0; j < r.y1; j++) {
+            for (int i = r.x0; i < r.x1; i++) {
+                size_t at = (size_t)j * w + i;
+                if (!queued[(size_t)(j - r.y0) * rw + (i - r.x0)] && !known[at]) {
+                    iterations[at] = interior;
+                    count++;
+                }
+            }
+        }
+        filled += count;
+    }
+
+    // Estimates the distance to the set at the corners of the rectangle. The set keeps at least a
+    // quarter of the estimate away, so once that exceeds the diagonal at every corner the rectangle
+    // holds no point of the set and its counts vary smoothly: they are interpolated from the corners
+    // (integer counts are filled only where the corners agree). Failing that, a uniform border fills
+    // it as in Mariani-Silver, which catches the interior that the estimates say nothing about, or it
+    // is split in four, down to blocks computed pixel by pixel. There, escaped pixels whose estimate
+    // is under half a pixel are drawn as the set, so filaments thinner than a pixel stay connected.
+    void distanceFill(const Pass& pass, Rect r) {
+        int w = (int)width;
+        vector<int> pixels;
+        if (r.x1 - r.x0 <= 4 || r.y1 - r.y0 <= 4) {
+            for (int j = r.y0; j < r.y1; j++) {
+                for (int i = r.x0; i < r.x1; i++) {
+                    pixels.push_back(j * w + i);
+                }
+            }
+            computePixels(pass, pixels.data(), (int)pixels.size(), true);
+            float interior = (float)iterationCap(pass.view.max_iter);
+            double half_pixel = 0.5 * std::min(pass.view.viewport.span_x / width, pass.view.viewport.span_y / height);
+            long long count = 0;
+            for (int at : pixels) {
+                if (iterations[at] != interior && distances[at] < half_pixel) {
+                    iterations[at] = interior;
+                    count++;
+                }
+            }
+            outlined += count;
+            return;
+        }
+
+        int corners[4] = {r.y0 * w + r.x0, r.y0 * w + r.x1 - 1, (r.y1 - 1) * w + r.x0, (r.y1 - 1) * w + r.x1 - 1};
+        computePixels(pass, corners, 4, true);
+        int cw = r.x1 - 1 - r.x0, ch = r.y1 - 1 - r.y0;
+        double diagonal = std::hypot(pass.view.viewport.span_x * cw / width, pass.view.viewport.span_y * ch / height);
+        bool empty = std::all_of(corners, corners + 4, [&](int at) { return distances[at] / 4 > diagonal; });
+        float v00 = iterations[corners[0]], v10 = iterations[corners[1]];
+        float v01 = iterations[corners[2]], v11 = iterations[corners[3]];
+        if (empty && (pass.view.smooth || (v00 == v10 && v00 == v01 && v00 == v11))) {
+            long long count = 0;
+            for (int j = r.y0; j < r.y1; j++) {
+                float v = (float)(j - r.y0) / ch;
+                for (int i = r.x0; i < r.x1; i++) {
+                    size_t at = (size_t)j * w + i;
+                    if (!known[at]) {
+                        float u = (float)(i - r.x0) / cw;
+                        iterations[at] = (1 - v) * ((1 - u) * v00 + u * v10) + v * ((1 - u) * v01 + u * v11);
+                        count++;
+                    }
+                }
+            }
+            filled += count;
+            return;
+        }
+        if (fillUniform(pass, r)) {
+            return;
+        }
+
+        int mx = (r.x0 + r.x1) / 2, my = (r.y0 + r.y1) / 2;
+        distanceFill(pass, {r.x0, r.y0, mx, my});
+        distanceFill(pass, {mx, r.y0, r.x1, my});
+        distanceFill(pass, {r.x0, my, mx, r.y1});
+        distanceFill(pass, {mx, my, r.x1, r.y1});
+    }
+
+    // Position of sample s inside its cell of the aa_grid x aa_grid grid over the pixel, in [0, 1).
+    // A hash rather than a random generator, so the same view always gets the same samples.
+    static double jitter(uint32_t at, int s, int axis) {
+        uint32_t x = at * 0x9e3779b1u ^ (uint32_t)(2 * s + axis) * 0x85ebca77u;
+        x ^= x >> 15;
+        x *= 0x2c1b3c6du;
+        x ^= x >> 12;
+        x *= 0x297a2d39u;
+        x ^= x >> 15;
+        return (x >> 8) * (1.0 / (1 << 24));
+    }
+
+    static int channelSpread(uint32_t a, uint32_t b) {
+        int spread = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+            spread = std::max(spread, std::abs((int)(a >> shift & 0xff) - (int)(b >> shift & 0xff)));
+        }
+        return spread;
+    }
+
+    // Computes the listed cells of every listed pixel into its block of aa_counts, 32 samples per kernel call.
+    void sampleCells(const Pass& pass, const vector<int>& pixels, const vector<int>& cells) {
+        int w = (int)width;
+        const int per_task = 128;
+        int total = (int)(pixels.size() * cells.size());
+        pool.parallelFor((total + per_task - 1) / per_task, [&](int task) {
+            if (generation != pass.gen) {
+                return;
+            }
+            double xs[32], ys[32], iters[32];
+            size_t at[32];
+            int end = std::min(total, (task + 1) * per_task);
+            for (int k = task * per_task; k < end;) {
+                int count = 0;
+                for (; k < end && count < 32; k++) {
+                    int pixel = pixels[k / cells.size()], cell = cells[k % cells.size()];
+                    xs[count] = pointX(pass, pixel % w + (cell % aa_grid + jitter(pixel, cell, 0)) / aa_grid);
+                    ys[count] = pointY(pass, pixel / w + (cell / aa_grid + jitter(pixel, cell, 1)) / aa_grid);
+                    at[count++] = (size_t)aa_slot[pixel] * aa_samples + cell;
+                }
+                computePoints(pass, xs, ys, count, iters);
+                for (int r = 0; r < count; r++) {
+                    aa_counts[at[r]] = (float)iters[r];
+                }
+            }
+        });
+    }
+
+    // Adaptive anti-aliasing. A pixel whose colour differs from one of its four neighbours' by more than
+    // aa_contrast in some channel sits on an edge. Edge pixels first get one jittered sample in each
+    // quadrant of the aa_grid x aa_grid grid (a rotated-grid pattern), standing in for the whole quadrant;
+    // only those whose four samples still disagree get the remaining cells. colorize averages the colours
+    // of the block. The tests run on the palette of the last colorize, so count jumps the palette does
+    // not show cost nothing. Pixels that already have samples (carried over by a pan) keep them.
+    void supersample(const Pass& pass) {
+        int w = (int)width, h = (int)height;
+        if (aa_slot.empty()) {
+            aa_slot.assign((size_t)w * h, -1);
+        }
+        vector<uint8_t> edge((size_t)w * h, 0);
+        pool.parallelFor(h, [&](int j) {
+            for (int i = 0; i < w; i++) {
+                size_t at = (size_t)j * w + i;
+                uint32_t color = palette.color(iterations[at]);
+                auto differs = [&](size_t other) {
+                    return channelSpread(color, palette.color(iterations[other])) > aa_contrast;
+                };
+                edge[at] = aa_slot[at] < 0 && ((i > 0 && differs(at - 1)) || (i + 1 < w && differs(at + 1)) ||
+                                               (j > 0 && differs(at - w)) || (j + 1 < h && differs(at + w)));
+            }
+        });
+
+        vector<int> pixels;
+        int first = (int)(aa_counts.size() / aa_samples);
+        for (size_t at = 0; at < edge.size(); at++) {
+            if (edge[at]) {
+                aa_slot[at] = first + (int)pixels.size();
+                pixels.push_back((int)at);
+            }
+        }
+        aa_counts.resize(aa_counts.size() + pixels.size() * aa_samples);
+        supersampled = (long long)pixels.size();
+
+        const int half = aa_grid / 2;
+        vector<int> quadrant_cells = {1, half * aa_grid - 1, half * aa_grid, aa_samples - half}, other_cells;
+        for (int cell = 0; cell < aa_samples; cell++) {
+            if (std::find(quadrant_cells.begin(), quadrant_cells.end(), cell) == quadrant_cells.end()) {
+                other_cells.push_back(cell);
+            }
+        }
+        sampleCells(pass, pixels, quadrant_cells);
+        if (generation != pass.gen) {
+            return;
+        }
+
+        vector<uint8_t> refine(pixels.size(), 0);
+        pool.parallelFor((int)pixels.size(), [&](int p) {
+            float* block = &aa_counts[(size_t)aa_slot[pixels[p]] * aa_samples];
+            int spread = 0;
+            for (int a : quadrant_cells) {
+                for (int b : quadrant_cells) {
+                    spread = std::max(spread, channelSpread(palette.color(block[a]), palette.color(block[b])));
+                }
+            }
+            refine[p] = spread > aa_contrast;
+            for (int cell = 0; cell < aa_samples; cell++) {
+                int x = cell % aa_grid / half, y = cell / aa_grid / half;
+                block[cell] = block[quadrant_cells[y * 2 + x]];
+            }
+        });
+        vector<int> refined;
+        for (size_t p = 0; p < pixels.size(); p++) {
+            if (refine[p]) {
+                refined.push_back(pixels[p]);
+            }
+        }
+        sampleCells(pass, refined, other_cells);
+        fully_supersampled = (long long)refined.size();
     }
 
     void processSelection() {
@@ -143,28 +1171,39 @@ private:
         int x_start = (dx > 0) ? start_dot.x : start_dot.x - size;
         int y_start = (dy > 0) ? start_dot.y : start_dot.y - size;
 
-        double new_x_min = x_min + (x_max - x_min) * x_start / width;
-        double new_x_max = x_min + (x_max - x_min) * (x_start + size) / width;
-        double new_y_min = y_min + (y_max - y_min) * y_start / height;
-        double new_y_max = y_min + (y_max - y_min) * (y_start + size) / height;
-
-        prev_x.push_back({x_min, x_max});
-        prev_y.push_back({y_min, y_max});
-        version++;
+        Viewport next;
+        next.span_x = viewport.span_x * size / width;
+        next.span_y = viewport.span_y * size / height;
 
-        x_min = new_x_min;
-        x_max = new_x_max;
-        y_min = new_y_min;
-        y_max = new_y_max;
+        // enough fraction bits to tell the new pixels apart
+        int frac = std::max(viewport.x_min.fracLimbs(),
+                            FixedPoint::limbsFor(std::min(next.span_x / width, next.span_y / height)));
+        next.x_min = viewport.x_min.withPrecision(frac) + FixedPoint(viewport.span_x * x_start / width, frac);
+        next.y_min = viewport.y_min.withPrecision(frac) + FixedPoint(viewport.span_y * y_start / height, frac);
 
-        draw();
-        texture.loadFromImage(image);
+        viewport = next;
 
+        requestFrame();
     }
 };
 
-int main() {
-    MandelbrotApp app(1024, 980, 100, 'j'); // set name m -> mandelbrot
+int main(int argc, char* argv[]) {
+    unsigned threads = argc > 1 ? (unsigned)atoi(argv[1]) : 0; // 0 -> all cores
+    vector<Gradient> loaded; // further arguments are gradient files, see palette.hpp
+    string tile_pack;        // or --tiles FILE: tiled frames, keeping the tiles in FILE across runs
+    for (int k = 2; k < argc; k++) {
+        if (string(argv[k]) == "--tiles" && k + 1 < argc) {
+            tile_pack = argv[++k];
+            continue;
+        }
+        Gradient gradient;
+        if (loadGradient(argv[k], gradient)) {
+            loaded.push_back(gradient);
+        } else {
+            cerr << "cannot load gradient " << argv[k] << '\n';
+        }
+    }
+    MandelbrotApp app(1024, 980, 100, 'j', threads, loaded, tile_pack); // set name m -> mandelbrot
                                                                        // set_name j -> julia
     app.run();
     return 0;
@@ -0,0 +1,197 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fractal.hpp"
+
+// Colouring without per-pixel maths: a gradient is sampled once into a table of packed RGBA pixels,
+// and each pixel is then one index computation and one load from that table.
+//
+// Gradient files are plain text, one stop per line as "position r g b" with position in [0, 1]
+// and channels in 0..255. An optional "cyclic N" line makes the gradient repeat every N iterations
+// instead of being spread once over the colour range. '#' starts a comment.
+
+struct GradientStop {
+    double position;
+    Rgb color;
+};
+
+struct Gradient {
+    std::string name;
+    std::vector<GradientStop> stops; // sorted by position
+    double period = 0;               // iterations per repeat; 0 -> spread over the colour range once
+};
+
+// RGBA in memory order on a little-endian machine, the layout sf::Texture::update takes.
+inline uint32_t packRgba(Rgb color) {
+    return (uint32_t)color.r | (uint32_t)color.g << 8 | (uint32_t)color.b << 16 | 0xff000000u;
+}
+
+inline Rgb unpackRgb(uint32_t pixel) {
+    return {(uint8_t)pixel, (uint8_t)(pixel >> 8), (uint8_t)(pixel >> 16)};
+}
+
+// Linear interpolation between the stops around t; clamped to the first and last stop.
+inline Rgb gradientColor(const Gradient& gradient, double t) {
+    const std::vector<GradientStop>& stops = gradient.stops;
+    if (stops.empty()) {
+        return {0, 0, 0};
+    }
+    if (t <= stops.front().position) {
+        return stops.front().color;
+    }
+    for (size_t k = 1; k < stops.size(); k++) {
+        if (t <= stops[k].position) {
+            const GradientStop& a = stops[k - 1];
+            const GradientStop& b = stops[k];
+            double f = b.position > a.position ? (t - a.position) / (b.position - a.position) : 1.0;
+            auto mix = [f](uint8_t x, uint8_t y) { return (uint8_t)(x + (y - x) * f + 0.5); };
+            return {mix(a.color.r, b.color.r), mix(a.color.g, b.color.g), mix(a.color.b, b.color.b)};
+        }
+    }
+    return stops.back().color;
+}
+
+inline const std::vector<Gradient>& builtinGradients() {
+    static const std::vector<Gradient> gradients = [] {
+        // the original polynomial, finely enough sampled that the interpolation cannot be seen
+        Gradient classic = {"classic", {}};
+        for (int k = 0; k <= 256; k++) {
+            classic.stops.push_back({k / 256.0, classicColor(k / 256.0)});
+        }
+        return std::vector<Gradient>{
+            classic,
+            {"fire", {{0, {0, 0, 0}}, {0.3, {160, 0, 0}}, {0.6, {255, 140, 0}}, {0.85, {255, 240, 80}},
+                      {1, {255, 255, 255}}}},
+            {"ocean", {{0, {0, 0, 30}}, {0.4, {0, 60, 160}}, {0.75, {0, 200, 220}}, {1, {240, 255, 255}}}},
+            {"grayscale", {{0, {0, 0, 0}}, {1, {255, 255, 255}}}},
+            {"ultra", {{0, {0, 7, 100}}, {0.16, {32, 107, 203}}, {0.42, {237, 255, 255}}, {0.64, {255, 170, 0}},
+                       {0.86, {0, 2, 0}}, {1, {0, 7, 100}}}, 64},
+            {"rainbow", {{0, {255, 0, 0}}, {0.17, {255, 255, 0}}, {0.33, {0, 255, 0}}, {0.5, {0, 255, 255}},
+                         {0.67, {0, 0, 255}}, {0.83, {255, 0, 255}}, {1, {255, 0, 0}}}, 48},
+        };
+    }();
+    return gradients;
+}
+
+// Returns false if the file cannot be read or holds no valid stop; the gradient is named after the path.
+inline bool loadGradient(const std::string& path, Gradient& gradient) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    Gradient loaded = {path, {}};
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) {
+            continue;
+        }
+        if (first == "cyclic") {
+            if (!(fields >> loaded.period) || loaded.period <= 0) {
+                return false;
+            }
+            continue;
+        }
+        double position;
+        int r, g, b;
+        if (!(std::istringstream(first) >> position) || !(fields >> r >> g >> b) || position < 0 || position > 1) {
+            return false;
+        }
+        auto channel = [](int v) { return (uint8_t)std::min(std::max(v, 0), 255); };
+        loaded.stops.push_back({position, {channel(r), channel(g), channel(b)}});
+    }
+    if (loaded.stops.empty()) {
+        return false;
+    }
+    std::stable_sort(loaded.stops.begin(), loaded.stops.end(),
+                     [](const GradientStop& a, const GradientStop& b) { return a.position < b.position; });
+    gradient = loaded;
+    return true;
+}
+
+// A built-in gradient by name, otherwise the gradient file at that path.
+inline bool findGradient(const std::string& name, Gradient& gradient) {
+    for (const Gradient& builtin : builtinGradients()) {
+        if (builtin.name == name) {
+            gradient = builtin;
+            return true;
+        }
+    }
+    return loadGradient(name, gradient);
+}
+
+// The gradient sampled into a lookup table. Counts in [0, range) map over the table, where range is
+// color_scale times the period of a cyclic gradient or max_iter otherwise; cyclic gradients wrap,
+// the others clamp to the last entry. Counts at the iteration cap get the interior colour.
+class Palette {
+public:
+    static const int size = 4096; // a power of two, so cyclic indices wrap with a mask
+
+    // Resamples only when the gradient (by name) or the range changed since the last call.
+    void build(const Gradient& gradient, double max_iter, double color_scale = 1.0) {
+        double range = (gradient.period > 0 ? gradient.period : max_iter) * color_scale;
+        float new_cap = (float)iterationCap(max_iter);
+        if (gradient.name == built_name && range == built_range && new_cap == cap && !lut.empty()) {
+            return;
+        }
+        built_name = gradient.name;
+        built_range = range;
+        cap = new_cap;
+        wrap = gradient.period > 0 ? size - 1 : -1;
+        scale = range > 0 ? (float)(size / range) : 0.0f;
+
+        lut.resize(size + 1);
+        for (int k = 0; k < size; k++) {
+            lut[k] = packRgba(gradientColor(gradient, (double)k / size));
+        }
+        lut[size] = packRgba(interior);
+    }
+
+    uint32_t color(float iter) const {
+        return lut[index(iter, scale, cap, wrap)];
+    }
+
+    // A single gather per pixel. index() has no branches, and with the table parameters in locals and
+    // the output marked as not aliasing the table, the loop vectorizes into a hardware gather.
+    void colorize(const float* iters, int count, uint32_t* __restrict out) const {
+        const uint32_t* __restrict table = lut.data();
+        const float s = scale, c = cap;
+        const int w = wrap;
+        for (int k = 0; k < count; k++) {
+            out[k] = table[index(iters[k], s, c, w)];
+        }
+    }
+
+    // Mean colour of several samples of one pixel, for anti-aliasing.
+    uint32_t average(const float* iters, int count) const {
+        uint32_t r = 0, g = 0, b = 0;
+        for (int k = 0; k < count; k++) {
+            uint32_t pixel = color(iters[k]);
+            r += pixel & 0xff;
+            g += pixel >> 8 & 0xff;
+            b += pixel >> 16 & 0xff;
+        }
+        return packRgba({(uint8_t)((r + count / 2) / count), (uint8_t)((g + count / 2) / count),
+                         (uint8_t)((b + count / 2) / count)});
+    }
+
+private:
+    std::vector<uint32_t> lut; // size gradient entries, then the interior colour
+    std::string built_name;
+    double built_range = 0;
+    float cap = 0, scale = 0;
+    int wrap = -1; // size - 1 for cyclic gradients, so the mask wraps; all bits otherwise, so the min clamps
+    Rgb interior = {0, 0, 0};
+
+    static int index(float iter, float scale, float cap, int wrap) {
+        int i = (int)std::min(iter * scale, 2e9f) & wrap; // huge cyclic counts would overflow the int
+        i = std::min(i, size - 1);
+        return iter >= cap ? size : i;
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <vector>
+#include "fixed_point.hpp"
+#include "simd_kernels.hpp"
+
+// Deep-zoom engine. One reference orbit Z_n is iterated in FixedPoint for the centre of the view;
+// every pixel then only iterates its double-precision offset dz_n = z_n - Z_n:
+//     dz_{n+1} = (2 Z_n + dz_n) dz_n + dc
+// where dc is the pixel offset from the reference c (zero for Julia sets, which start from dz_0 instead).
+// When the offset stops being small against the full value (|z - Z_0| < |dz|, a precision glitch)
+// or the reference runs out, the pixel is rebased onto the start of the reference orbit.
+//
+// Series approximation: for the first iterations every offset in the frame follows a truncated
+// polynomial dz_n = sum b_k u^k in u = d / r, where d is the pixel offset and r the frame radius
+// (coefficients are kept pre-scaled by r^k so they stay finite at any depth). All pixels start at
+// the last iteration where that polynomial is still trustworthy.
+//
+// Offsets carry no periodicity check, so without the attraction test (see simd_kernels.hpp) every
+// interior pixel would run to max_iter.
+
+struct ReferenceOrbit {
+    std::vector<double> re, im; // Z_0 .. Z_last rounded to double; Z_last may already have escaped
+};
+
+inline ReferenceOrbit referenceOrbit(const FixedPoint& ref_x, const FixedPoint& ref_y, const EscapeParams& p) {
+    int frac = std::max(ref_x.fracLimbs(), ref_y.fracLimbs());
+    FixedPoint zr = p.julia ? ref_x : FixedPoint(0.0, frac);
+    FixedPoint zi = p.julia ? ref_y : FixedPoint(0.0, frac);
+    FixedPoint cr = p.julia ? FixedPoint(p.c_re, frac) : ref_x;
+    FixedPoint ci = p.julia ? FixedPoint(p.c_im, frac) : ref_y;
+
+    const long long limit = (long long)iterationCap(p.max_iter);
+    ReferenceOrbit orbit;
+    for (long long n = 0;; n++) {
+        double r = zr.toDouble(), i = zi.toDouble();
+        orbit.re.push_back(r);
+        orbit.im.push_back(i);
+        // always keep Z_1 so a rebased pixel has somewhere to step to
+        if ((r * r + i * i > 4 || n >= limit) && orbit.re.size() > 1) {
+            break;
+        }
+        FixedPoint rr = zr * zr, ii = zi * zi, ri = zr * zi;
+        zr = rr - ii + cr;
+        zi = ri + ri + ci;
+    }
+    return orbit;
+}
+
+struct SeriesApproximation {
+    int skip = 0;              // iterations every pixel starts past
+    double radius = 1.0;       // r, the largest pixel offset in the frame
+    std::vector<Complex> coeffs; // b_1 .. b_K at iteration `skip`
+    double error_bound = 0.0;  // size of the last term |b_K|, in complex-plane units
+
+    // dz_skip for the offset (dx, dy)
+    Complex evaluate(double dx, double dy) const {
+        Complex u(dx / radius, dy / radius);
+        Complex sum(0.0, 0.0);
+        for (size_t k = coeffs.size(); k-- > 0;) {
+            sum = (sum + coeffs[k]) * u;
+        }
+        return sum;
+    }
+};
+
+const int series_terms = 6;
+
+// Iteration count of one offset with plain perturbation, optionally started from the series.
+inline double perturbPoint(const ReferenceOrbit& orbit, const SeriesApproximation* series, double dx, double dy,
+                           const EscapeParams& p, bool* glitched = nullptr, bool* attracted = nullptr) {
+    const size_t last = orbit.re.size() - 1;
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const double bailout = p.smooth ? smooth_bailout * smooth_bailout : 4;
+    double dcr = p.julia ? 0.0 : dx, dci = p.julia ? 0.0 : dy;
+    double dzr = p.julia ? dx : 0.0, dzi = p.julia ? dy : 0.0;
+    size_t m = 0;
+    long long n = 0;
+
+    if (series && series->skip > 0) {
+        Complex dz = series->evaluate(dx, dy);
+        dzr = dz.real;
+        dzi = dz.imag;
+        m = series->skip;
+        n = series->skip;
+    }
+    // the attraction test's derivative along the full orbit Z + dz, from the first step taken here on
+    const bool attraction = p.shortcuts && p.attraction;
+    const long long start = n;
+    double dr = 1, di = 0;
+
+    for (; n < limit; n++) {
+        double zr = orbit.re[m] + dzr, zi = orbit.im[m] + dzi;
+        if (zr * zr + zi * zi > bailout) {
+            return p.smooth ? smoothCount(n, zr * zr + zi * zi) : (double)n;
+        }
+        if (attraction && n > start) {
+            double next_dr = 2 * (zr * dr - zi * di);
+            di = 2 * (zr * di + zi * dr);
+            dr = next_dr;
+            // tested every 16 steps: this loop has no spare throughput, and an attracted orbit stays so
+            if (((n - start) & 15) == 0 &&
+                (dr * dr + di * di) * attractionWeight(n - start) < attraction_limit * attraction_limit) {
+                if (attracted) {
+                    *attracted = true;
+                }
+                return (double)limit;
+            }
+        }
+        double br = zr - orbit.re[0], bi = zi - orbit.im[0];
+        if (br * br + bi * bi < dzr * dzr + dzi * dzi || m == last) {
+            dzr = br;
+            dzi = bi;
+            m = 0;
+            if (glitched) {
+                *glitched = true;
+            }
+        }
+        double tr = 2 * orbit.re[m] + dzr, ti = 2 * orbit.im[m] + dzi;
+        double next = tr * dzr - ti * dzi + dcr;
+        dzi = tr * dzi + ti * dzr + dci;
+        dzr = next;
+        m++;
+    }
+    return (double)n;
+}
+
+// Steps the coefficients along the reference orbit while the last term stays below `tolerance`
+// (a fraction of the pixel spacing) and no pixel of the frame can have escaped yet, then checks
+// the skip against plain perturbation on probe points around the frame edge and halves it on mismatch.
+inline SeriesApproximation seriesApproximation(const ReferenceOrbit& orbit, const EscapeParams& p,
+                                               double half_x, double half_y, double spacing) {
+    const double tolerance = 1e-3 * spacing;
+    SeriesApproximation series;
+    series.radius = std::sqrt(half_x * half_x + half_y * half_y);
+    if (series.radius == 0) {
+        return series;
+    }
+
+    std::vector<Complex> b(series_terms, Complex(0.0, 0.0));
+    if (p.julia) {
+        b[0] = Complex(series.radius, 0.0); // dz_0 = d = r u
+    }
+    std::vector<std::vector<Complex>> history = {b};
+
+    for (size_t n = 0; n + 2 < orbit.re.size() && n + 1 < p.max_iter; n++) {
+        Complex two_z(2 * orbit.re[n], 2 * orbit.im[n]);
+        std::vector<Complex> next(series_terms);
+        for (int k = 0; k < series_terms; k++) {
+            Complex sum = two_z * b[k];
+            // sum of b_i b_j with i + j = k + 1 (terms are 1-based)
+            for (int i = 0; i < k; i++) {
+                sum = sum + b[i] * b[k - 1 - i];
+            }
+            next[k] = sum;
+        }
+        if (!p.julia) {
+            next[0] = next[0] + Complex(series.radius, 0.0);
+        }
+
+        double bound = 0;
+        for (const Complex& term : next) {
+            bound += term.magnitude();
+        }
+        Complex z(orbit.re[n + 1], orbit.im[n + 1]);
+        if (!(next.back().magnitude() < tolerance) || z.magnitude() + bound > 2) {
+            break;
+        }
+        b = next;
+        history.push_back(b);
+    }
+
+    // integer counts, so rounding in the smooth fraction cannot reject a good skip; no attraction
+    // test, whose derivative starts wherever the pixel does
+    EscapeParams counts = p;
+    counts.smooth = false;
+    counts.attraction = false;
+    const double probes[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    for (int skip = (int)history.size() - 1; skip > 0; skip /= 2) {
+        series.skip = skip;
+        series.coeffs = history[skip];
+        bool valid = true;
+        for (const auto& probe : probes) {
+            double dx = probe[0] * half_x, dy = probe[1] * half_y;
+            if (perturbPoint(orbit, &series, dx, dy, counts) != perturbPoint(orbit, nullptr, dx, dy, counts)) {
+                valid = false;
+                break;
+            }
+        }
+        if (valid) {
+            series.error_bound = series.coeffs.back().magnitude();
+            return series;
+        }
+    }
+    series.skip = 0;
+    series.coeffs.clear();
+    return series;
+}
+
+// Iteration counts for the pixels at offsets (dxs[k], dys[k]) from the reference point.
+inline void perturbPoints(const ReferenceOrbit& orbit, const SeriesApproximation* series, const double* dxs,
+                          const double* dys, int count, const EscapeParams& p, double* out,
+                          EscapeStats* stats = nullptr) {
+    long long rebased = 0, attracted = 0;
+
+    for (int k = 0; k < count; k++) {
+        bool glitched = false, interior = false;
+        out[k] = perturbPoint(orbit, series, dxs[k], dys[k], p, &glitched, &interior);
+        rebased += glitched;
+        attracted += interior;
+    }
+
+    if (stats) {
+        stats->points += count;
+        stats->rebased += rebased;
+        stats->periodic += attracted;
+    }
+}
+
+// Iteration counts for the pixels at offsets (dxs[k], dy) from the reference point.
+inline void perturbRow(const ReferenceOrbit& orbit, const SeriesApproximation* series, const double* dxs, double dy,
+                       int count, const EscapeParams& p, double* out, EscapeStats* stats = nullptr) {
+    std::vector<double> dys(count, dy);
+    perturbPoints(orbit, series, dxs, dys.data(), count, p, out, stats);
+}
@@ -0,0 +1,1138 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <type_traits>
+#include "double_double.hpp"
+#include "fractal.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FTL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Vectorized escape-time kernels. Each lane follows escapeTime() in fractal.hpp: z = z * z + c
+// while |z|^2 <= 4, at most iterationCap(max_iter) times, with a per-lane mask for escaped points.
+// Every kernel exists in float (twice the lanes), double and double-double (two registers per value);
+// long double runs the scalar loop.
+// The SIMD kernels always fuse the imaginary update; the scalar loop does where the build target
+// has FMA, so counts can differ by rounding between the two otherwise.
+//
+// Two shortcuts keep the result identical to the brute-force loop:
+//  - Mandelbrot points inside the main cardioid or the period-2 bulb are never iterated;
+//  - Brent-style periodicity: z is saved at steps 1, 2, 4, 8, ... and if a later z equals the
+//    saved one bit for bit, the orbit is a floating-point cycle and can never escape.
+// A third one, opt-in (EscapeParams::attraction), is a test rather than a proof: the product d of
+// 2 z_k along the orbit, the derivative of z_n with respect to z_1, shrinks geometrically once the
+// orbit is attracted to a cycle, long before the cycle repeats bit for bit. See attractionWeight().
+// Float kernels skip it: their cycles repeat within a few dozen steps, so it would only cost.
+
+// Bumped whenever a change to the kernels or to the precision choice can change a count, so that
+// counts persisted by an older build (the tile pack, see tile_cache.hpp) are thrown away.
+const uint32_t kernel_version = 2;
+
+enum class SimdLevel { Scalar, Avx2, Avx512 };
+
+inline const char* simdName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Avx512: return "avx512";
+        case SimdLevel::Avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+inline SimdLevel detectSimd() {
+#ifdef FTL_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevel::Avx2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+enum class Precision { Float, Double, LongDouble, DoubleDouble };
+
+inline const char* precisionName(Precision precision) {
+    switch (precision) {
+        case Precision::Float: return "float";
+        case Precision::LongDouble: return "long double";
+        case Precision::DoubleDouble: return "double-double";
+        default: return "double";
+    }
+}
+
+// Bits kept between the rounding of a coordinate and the pixel spacing; 12 puts the double limit near 1e-12.
+const int precision_guard_bits = 12;
+
+// Significand bits of a double-double: two doubles' worth, less the bits the normalization can lose.
+const int double_double_digits = 104;
+
+// Whether the precision resolves pixels `spacing` apart at coordinates up to `scale` in magnitude.
+inline bool precisionFits(Precision precision, double spacing, double scale) {
+    int digits = precision == Precision::Float          ? std::numeric_limits<float>::digits
+                 : precision == Precision::Double       ? std::numeric_limits<double>::digits
+                 : precision == Precision::DoubleDouble ? double_double_digits
+                                                        : std::numeric_limits<long double>::digits;
+    return spacing >= std::ldexp(std::max(scale, 1.0), precision_guard_bits - digits);
+}
+
+// Rounding errors grow along the orbit: past this many iterations float visibly changes the counts
+// of Julia sets (0.04% of the pixels off by more than 5% at 200, 1.8% at 500).
+const double float_max_iter = 200;
+
+// The cheapest SIMD precision that fits, double if neither does. Past double the renderer switches
+// to perturbation: with the series skip it beats the scalar long double loop by about 3x and the
+// vector double-double loop, at 7-8x the cost of double per iteration, by 3x to over 100x.
+inline Precision selectPrecision(double spacing, double scale, double max_iter) {
+    bool use_float = max_iter <= float_max_iter && precisionFits(Precision::Float, spacing, scale);
+    return use_float ? Precision::Float : Precision::Double;
+}
+
+struct EscapeParams {
+    bool julia;     // false: z0 = 0, c = pixel; true: z0 = pixel, c = (c_re, c_im)
+    double c_re, c_im;
+    double max_iter;
+    bool shortcuts = true; // cardioid/bulb rejection and periodicity checking
+    Precision precision = Precision::Double;
+    bool smooth = false; // escaped points return smoothCount() instead of the integer count
+    // Opt-in, with shortcuts: the derivative attraction test for the interior. A heuristic with no
+    // proven bound behind its threshold: it can call a point interior that escapes slowly enough,
+    // so counts are no longer guaranteed to match the brute-force loop.
+    bool attraction = false;
+    DoubleDouble origin_re = 0.0, origin_im = 0.0; // points are offsets from here, so the origin keeps its digits
+};
+
+// The attraction test declares a point interior once |d|^2 attractionWeight(m) < attraction_limit^2
+// after m steps of d, i.e. |d| m^2 < attraction_limit. An escaping orbit shrinks d too while it
+// creeps past a parabolic point, but only like 1 / m^2, which the m^2 cancels: escaping points of the
+// cusps, necks and parabolic Julia sets checked against the brute-force loop stay above 0.05.
+// A product rather than a bound, so the loops never divide.
+const double attraction_limit = 1e-3;
+
+inline double attractionWeight(long long m) {
+    double m2 = (double)m * (double)m;
+    return m2 * m2;
+}
+
+// origin + offset rounded to T; the sum is formed in double unless T is wider
+template <typename T>
+inline T pointCoord(const DoubleDouble& origin, double offset) {
+    return (T)((double)origin + offset);
+}
+
+template <>
+inline long double pointCoord<long double>(const DoubleDouble& origin, double offset) {
+    return (long double)origin + offset;
+}
+
+template <>
+inline DoubleDouble pointCoord<DoubleDouble>(const DoubleDouble& origin, double offset) {
+    return origin + offset;
+}
+
+// How many points each shortcut finished; shared by all tiles of a frame.
+struct EscapeStats {
+    std::atomic<long long> points{0};
+    std::atomic<long long> cardioid{0};
+    std::atomic<long long> bulb{0};
+    std::atomic<long long> periodic{0}; // by the periodicity check or the attraction test
+    std::atomic<long long> rebased{0}; // perturbation pixels that hit a glitch and were rebased
+
+    void reset() {
+        points = 0;
+        cardioid = 0;
+        bulb = 0;
+        periodic = 0;
+        rebased = 0;
+    }
+
+    void report(std::ostream& out) const {
+        double total = points > 0 ? (double)points : 1.0;
+        out << "cardioid " << 100.0 * cardioid / total << "%, bulb " << 100.0 * bulb / total
+            << "%, periodic " << 100.0 * periodic / total << "%, rebased " << 100.0 * rebased / total
+            << "% of " << points << " points\n";
+    }
+};
+
+// Returns a bitmask of the points that were finished by the periodicity check or the attraction test.
+template <typename T>
+inline unsigned escapeScalar(const double* xs, const double* ys, int count, const EscapeParams& p, double* out) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const T bailout = p.smooth ? (T)(smooth_bailout * smooth_bailout) : 4;
+    const bool attraction = p.attraction && !std::is_same<T, float>::value;
+    unsigned periodic = 0;
+    for (int k = 0; k < count; k++) {
+        T x = pointCoord<T>(p.origin_re, xs[k]), y = pointCoord<T>(p.origin_im, ys[k]);
+        T zr = p.julia ? x : 0, zi = p.julia ? y : 0;
+        T cr = p.julia ? (T)p.c_re : x, ci = p.julia ? (T)p.c_im : y;
+        T sr = zr, si = zi;
+        double dr = 1, di = 0; // double is plenty for the attraction test, which only needs the size
+
+        int steps = 0, next_save = 1;
+        long long n = 0;
+        double norm = 0;
+        for (; n < limit; n++) {
+            T rr = zr * zr, ii = zi * zi;
+            if (rr + ii > bailout) {
+                norm = (double)(rr + ii);
+                break;
+            }
+            zi = mulAdd(zr + zr, zi, ci);
+            zr = rr - ii + cr;
+            if (!p.shortcuts) {
+                continue;
+            }
+            if (attraction) {
+                double two_r = 2 * (double)zr, two_i = 2 * (double)zi;
+                double next_dr = two_r * dr - two_i * di;
+                di = two_r * di + two_i * dr;
+                dr = next_dr;
+            }
+            if ((zr == sr && zi == si) || (attraction && (dr * dr + di * di) * attractionWeight(n + 1) < attraction_limit * attraction_limit)) {
+                n = limit;
+                periodic |= 1u << k;
+                break;
+            }
+            if (++steps == next_save) {
+                sr = zr;
+                si = zi;
+                steps = 0;
+                next_save *= 2;
+            }
+        }
+        out[k] = p.smooth && n < limit ? smoothCount(n, norm) : (double)n;
+    }
+    return periodic;
+}
+
+// escapeScalar() that also carries the derivative of z: dz/dc for the Mandelbrot set, dz/dz0 for Julia
+// sets. Escaped points run on to smooth_bailout, where 2 |z| ln|z| / |dz| estimates their distance to
+// the set (the true distance lies between a quarter of the estimate and the estimate itself); points
+// that never escape get 0. The counts are the ones escapeScalar() returns.
+template <typename T>
+inline unsigned escapeDistanceScalar(const double* xs, const double* ys, int count, const EscapeParams& p, double* out,
+                                     double* distance) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const T far = (T)(smooth_bailout * smooth_bailout);
+    const T bailout = p.smooth ? far : 4;
+    unsigned periodic = 0;
+    for (int k = 0; k < count; k++) {
+        T x = pointCoord<T>(p.origin_re, xs[k]), y = pointCoord<T>(p.origin_im, ys[k]);
+        T zr = p.julia ? x : 0, zi = p.julia ? y : 0;
+        T cr = p.julia ? (T)p.c_re : x, ci = p.julia ? (T)p.c_im : y;
+        T dr = p.julia ? 1 : 0, di = 0;
+        T sr = zr, si = zi;
+        int steps = 0, next_save = 1;
+        long long n = 0, escaped = -1; // the count, once |z|^2 passed the bailout
+        double norm = 0;
+        for (; n < limit; n++) {
+            T rr = zr * zr, ii = zi * zi;
+            if (escaped < 0 && rr + ii > bailout) {
+                escaped = n;
+                norm = (double)(rr + ii);
+            }
+            if (rr + ii > far) {
+                break;
+            }
+            T two_r = zr + zr, two_i = zi + zi;
+            T next_dr = two_r * dr - two_i * di + (p.julia ? 0 : 1);
+            di = two_r * di + two_i * dr;
+            dr = next_dr;
+            zi = mulAdd(two_r, zi, ci);
+            zr = rr - ii + cr;
+            if (!p.shortcuts || escaped >= 0) {
+                continue;
+            }
+            if (zr == sr && zi == si) {
+                n = limit;
+                periodic |= 1u << k;
+                break;
+            }
+            if (++steps == next_save) {
+                sr = zr;
+                si = zi;
+                steps = 0;
+                next_save *= 2;
+            }
+        }
+        if (escaped < 0) {
+            out[k] = (double)n;
+            distance[k] = 0;
+            continue;
+        }
+        out[k] = p.smooth ? smoothCount(escaped, norm) : (double)escaped;
+        double zz = (double)(zr * zr + zi * zi), dd = (double)(dr * dr + di * di);
+        distance[k] = dd > 0 ? std::sqrt(zz / dd) * std::log(zz) : 0;
+    }
+    return periodic;
+}
+
+#ifdef FTL_X86_SIMD
+
+// Double blocks count in int64 lanes; every AVX2 CPU detectSimd() accepts also has FMA.
+__attribute__((target("avx2,fma")))
+inline unsigned escapeAvx2Block(const double* xs, const double* ys, const EscapeParams& p, double* out) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m256d bailout = _mm256_set1_pd(p.smooth ? smooth_bailout * smooth_bailout : 4.0);
+    const __m256i cap = _mm256_set1_epi64x(limit);
+    __m256d px = _mm256_add_pd(_mm256_set1_pd((double)p.origin_re), _mm256_loadu_pd(xs));
+    __m256d py = _mm256_add_pd(_mm256_set1_pd((double)p.origin_im), _mm256_loadu_pd(ys));
+    __m256d zr = p.julia ? px : _mm256_setzero_pd();
+    __m256d zi = p.julia ? py : _mm256_setzero_pd();
+    __m256d cr = p.julia ? _mm256_set1_pd(p.c_re) : px;
+    __m256d ci = p.julia ? _mm256_set1_pd(p.c_im) : py;
+    __m256d sr = zr, si = zi;
+    __m256d dr = _mm256_set1_pd(1.0), di = _mm256_setzero_pd();
+    const __m256d limit2 = _mm256_set1_pd(attraction_limit * attraction_limit);
+    __m256i n = _mm256_setzero_si256();
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d periodic = _mm256_setzero_pd();
+    __m256d norm = _mm256_setzero_pd(); // |z|^2 of each lane when it escaped
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m256d rr = _mm256_mul_pd(zr, zr);
+        __m256d ii = _mm256_mul_pd(zi, zi);
+        __m256d mag = _mm256_add_pd(rr, ii);
+        __m256d inside = _mm256_cmp_pd(mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm256_blendv_pd(norm, mag, _mm256_andnot_pd(inside, active));
+        }
+        active = _mm256_and_pd(active, inside);
+        if (_mm256_movemask_pd(active) == 0) {
+            break;
+        }
+        n = _mm256_sub_epi64(n, _mm256_castpd_si256(active)); // active lanes are -1
+        zi = _mm256_fmadd_pd(_mm256_add_pd(zr, zr), zi, ci);
+        zr = _mm256_add_pd(_mm256_sub_pd(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __m256d cycled = _mm256_and_pd(active, _mm256_and_pd(_mm256_cmp_pd(zr, sr, _CMP_EQ_OQ),
+                                                             _mm256_cmp_pd(zi, si, _CMP_EQ_OQ)));
+        if (p.attraction) {
+            __m256d two_r = _mm256_add_pd(zr, zr), two_i = _mm256_add_pd(zi, zi);
+            __m256d next_dr = _mm256_fmsub_pd(two_r, dr, _mm256_mul_pd(two_i, di));
+            di = _mm256_fmadd_pd(two_r, di, _mm256_mul_pd(two_i, dr));
+            dr = next_dr;
+            __m256d d2 = _mm256_fmadd_pd(dr, dr, _mm256_mul_pd(di, di));
+            __m256d weighted = _mm256_mul_pd(d2, _mm256_set1_pd(attractionWeight(it + 1)));
+            __m256d attracted = _mm256_cmp_pd(weighted, limit2, _CMP_LT_OQ);
+            cycled = _mm256_or_pd(cycled, _mm256_and_pd(active, attracted));
+        }
+        if (_mm256_movemask_pd(cycled) != 0) {
+            n = _mm256_blendv_epi8(n, cap, _mm256_castpd_si256(cycled));
+            periodic = _mm256_or_pd(periodic, cycled);
+            active = _mm256_andnot_pd(cycled, active);
+            dr = _mm256_andnot_pd(cycled, dr); // finished lanes would decay into slow denormals
+            di = _mm256_andnot_pd(cycled, di);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    long long counts[4];
+    double norms[4];
+    _mm256_storeu_si256((__m256i*)counts, n);
+    _mm256_storeu_pd(norms, norm);
+    for (int l = 0; l < 4; l++) {
+        out[l] = p.smooth && counts[l] < limit ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+    }
+    return (unsigned)_mm256_movemask_pd(periodic);
+}
+
+__attribute__((target("avx512f")))
+inline unsigned escapeAvx512Block(const double* xs, const double* ys, const EscapeParams& p, double* out) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m512d bailout = _mm512_set1_pd(p.smooth ? smooth_bailout * smooth_bailout : 4.0);
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i cap = _mm512_set1_epi64(limit);
+    __m512d px = _mm512_add_pd(_mm512_set1_pd((double)p.origin_re), _mm512_loadu_pd(xs));
+    __m512d py = _mm512_add_pd(_mm512_set1_pd((double)p.origin_im), _mm512_loadu_pd(ys));
+    __m512d zr = p.julia ? px : _mm512_setzero_pd();
+    __m512d zi = p.julia ? py : _mm512_setzero_pd();
+    __m512d cr = p.julia ? _mm512_set1_pd(p.c_re) : px;
+    __m512d ci = p.julia ? _mm512_set1_pd(p.c_im) : py;
+    __m512d sr = zr, si = zi;
+    __m512d dr = _mm512_set1_pd(1.0), di = _mm512_setzero_pd();
+    const __m512d limit2 = _mm512_set1_pd(attraction_limit * attraction_limit);
+    __m512i n = _mm512_setzero_si512();
+    __mmask8 active = 0xFF;
+    __mmask8 periodic = 0;
+    __m512d norm = _mm512_setzero_pd();
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m512d rr = _mm512_mul_pd(zr, zr);
+        __m512d ii = _mm512_mul_pd(zi, zi);
+        __m512d mag = _mm512_add_pd(rr, ii);
+        __mmask8 inside = _mm512_mask_cmp_pd_mask(active, mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm512_mask_mov_pd(norm, active & (__mmask8)~inside, mag);
+        }
+        active = inside;
+        if (active == 0) {
+            break;
+        }
+        n = _mm512_mask_add_epi64(n, active, n, one);
+        zi = _mm512_fmadd_pd(_mm512_add_pd(zr, zr), zi, ci);
+        zr = _mm512_add_pd(_mm512_sub_pd(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __mmask8 cycled = _mm512_mask_cmp_pd_mask(active, zr, sr, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_pd_mask(cycled, zi, si, _CMP_EQ_OQ);
+        if (p.attraction) {
+            __m512d two_r = _mm512_add_pd(zr, zr), two_i = _mm512_add_pd(zi, zi);
+            __m512d next_dr = _mm512_fmsub_pd(two_r, dr, _mm512_mul_pd(two_i, di));
+            di = _mm512_fmadd_pd(two_r, di, _mm512_mul_pd(two_i, dr));
+            dr = next_dr;
+            __m512d d2 = _mm512_fmadd_pd(dr, dr, _mm512_mul_pd(di, di));
+            __m512d weighted = _mm512_mul_pd(d2, _mm512_set1_pd(attractionWeight(it + 1)));
+            cycled |= _mm512_mask_cmp_pd_mask(active, weighted, limit2, _CMP_LT_OQ);
+        }
+        if (cycled != 0) {
+            n = _mm512_mask_mov_epi64(n, cycled, cap);
+            periodic |= cycled;
+            active &= (__mmask8)~cycled;
+            dr = _mm512_maskz_mov_pd((__mmask8)~cycled, dr);
+            di = _mm512_maskz_mov_pd((__mmask8)~cycled, di);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    long long counts[8];
+    double norms[8];
+    _mm512_storeu_si512(counts, n);
+    _mm512_storeu_pd(norms, norm);
+    for (int l = 0; l < 8; l++) {
+        out[l] = p.smooth && counts[l] < limit ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+    }
+    return periodic;
+}
+
+// The distance kernel in double lanes. Lanes that passed the bailout stop counting but keep iterating
+// to smooth_bailout, and each lane's |z|^2 and |dz|^2 are kept from the step it got there.
+__attribute__((target("avx2,fma")))
+inline unsigned escapeAvx2BlockDistance(const double* xs, const double* ys, const EscapeParams& p, double* out,
+                                        double* distance) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m256d far = _mm256_set1_pd(smooth_bailout * smooth_bailout);
+    const __m256d bailout = p.smooth ? far : _mm256_set1_pd(4.0);
+    const __m256i cap = _mm256_set1_epi64x(limit);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d offset = p.julia ? zero : _mm256_set1_pd(1.0); // dz/dc gains 1 per step, dz/dz0 does not
+    __m256d px = _mm256_add_pd(_mm256_set1_pd((double)p.origin_re), _mm256_loadu_pd(xs));
+    __m256d py = _mm256_add_pd(_mm256_set1_pd((double)p.origin_im), _mm256_loadu_pd(ys));
+    __m256d zr = p.julia ? px : zero;
+    __m256d zi = p.julia ? py : zero;
+    __m256d cr = p.julia ? _mm256_set1_pd(p.c_re) : px;
+    __m256d ci = p.julia ? _mm256_set1_pd(p.c_im) : py;
+    __m256d dr = p.julia ? _mm256_set1_pd(1.0) : zero;
+    __m256d di = zero;
+    __m256d sr = zr, si = zi;
+    __m256i n = _mm256_setzero_si256();
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); // not at smooth_bailout yet
+    __m256d counting = active;                                    // not past the bailout yet
+    __m256d periodic = zero;
+    __m256d norm = zero;                 // |z|^2 at the bailout
+    __m256d far_z = zero, far_dz = zero; // |z|^2 and |dz|^2 at smooth_bailout
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m256d rr = _mm256_mul_pd(zr, zr);
+        __m256d ii = _mm256_mul_pd(zi, zi);
+        __m256d mag = _mm256_add_pd(rr, ii);
+        __m256d crossed = _mm256_and_pd(counting, _mm256_cmp_pd(mag, bailout, _CMP_GT_OQ));
+        norm = _mm256_blendv_pd(norm, mag, crossed);
+        counting = _mm256_andnot_pd(crossed, counting);
+        __m256d arrived = _mm256_and_pd(active, _mm256_cmp_pd(mag, far, _CMP_GT_OQ));
+        far_z = _mm256_blendv_pd(far_z, mag, arrived);
+        far_dz = _mm256_blendv_pd(far_dz, _mm256_fmadd_pd(dr, dr, _mm256_mul_pd(di, di)), arrived);
+        active = _mm256_andnot_pd(arrived, active);
+        if (_mm256_movemask_pd(active) == 0) {
+            break;
+        }
+        n = _mm256_sub_epi64(n, _mm256_castpd_si256(counting));
+        __m256d two_r = _mm256_add_pd(zr, zr), two_i = _mm256_add_pd(zi, zi);
+        __m256d next_dr = _mm256_add_pd(_mm256_fmsub_pd(two_r, dr, _mm256_mul_pd(two_i, di)), offset);
+        di = _mm256_fmadd_pd(two_r, di, _mm256_mul_pd(two_i, dr));
+        dr = next_dr;
+        zi = _mm256_fmadd_pd(two_r, zi, ci);
+        zr = _mm256_add_pd(_mm256_sub_pd(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __m256d cycled = _mm256_and_pd(counting, _mm256_and_pd(_mm256_cmp_pd(zr, sr, _CMP_EQ_OQ),
+                                                               _mm256_cmp_pd(zi, si, _CMP_EQ_OQ)));
+        if (_mm256_movemask_pd(cycled) != 0) {
+            n = _mm256_blendv_epi8(n, cap, _mm256_castpd_si256(cycled));
+            periodic = _mm256_or_pd(periodic, cycled);
+            counting = _mm256_andnot_pd(cycled, counting);
+            active = _mm256_andnot_pd(cycled, active);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    // lanes that passed the bailout but ran out of iterations before smooth_bailout
+    far_z = _mm256_blendv_pd(far_z, _mm256_fmadd_pd(zr, zr, _mm256_mul_pd(zi, zi)), active);
+    far_dz = _mm256_blendv_pd(far_dz, _mm256_fmadd_pd(dr, dr, _mm256_mul_pd(di, di)), active);
+
+    long long counts[4];
+    double norms[4], zz[4], dd[4];
+    _mm256_storeu_si256((__m256i*)counts, n);
+    _mm256_storeu_pd(norms, norm);
+    _mm256_storeu_pd(zz, far_z);
+    _mm256_storeu_pd(dd, far_dz);
+    for (int l = 0; l < 4; l++) {
+        bool escaped = counts[l] < limit;
+        out[l] = p.smooth && escaped ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+        distance[l] = escaped && dd[l] > 0 ? std::sqrt(zz[l] / dd[l]) * std::log(zz[l]) : 0;
+    }
+    return (unsigned)_mm256_movemask_pd(periodic);
+}
+
+__attribute__((target("avx512f")))
+inline unsigned escapeAvx512BlockDistance(const double* xs, const double* ys, const EscapeParams& p, double* out,
+                                          double* distance) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m512d far = _mm512_set1_pd(smooth_bailout * smooth_bailout);
+    const __m512d bailout = p.smooth ? far : _mm512_set1_pd(4.0);
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i cap = _mm512_set1_epi64(limit);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d offset = p.julia ? zero : _mm512_set1_pd(1.0);
+    __m512d px = _mm512_add_pd(_mm512_set1_pd((double)p.origin_re), _mm512_loadu_pd(xs));
+    __m512d py = _mm512_add_pd(_mm512_set1_pd((double)p.origin_im), _mm512_loadu_pd(ys));
+    __m512d zr = p.julia ? px : zero;
+    __m512d zi = p.julia ? py : zero;
+    __m512d cr = p.julia ? _mm512_set1_pd(p.c_re) : px;
+    __m512d ci = p.julia ? _mm512_set1_pd(p.c_im) : py;
+    __m512d dr = p.julia ? _mm512_set1_pd(1.0) : zero;
+    __m512d di = zero;
+    __m512d sr = zr, si = zi;
+    __m512i n = _mm512_setzero_si512();
+    __mmask8 active = 0xFF, counting = 0xFF;
+    __mmask8 periodic = 0;
+    __m512d norm = zero, far_z = zero, far_dz = zero;
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m512d rr = _mm512_mul_pd(zr, zr);
+        __m512d ii = _mm512_mul_pd(zi, zi);
+        __m512d mag = _mm512_add_pd(rr, ii);
+        __mmask8 crossed = _mm512_mask_cmp_pd_mask(counting, mag, bailout, _CMP_GT_OQ);
+        norm = _mm512_mask_mov_pd(norm, crossed, mag);
+        counting &= (__mmask8)~crossed;
+        __mmask8 arrived = _mm512_mask_cmp_pd_mask(active, mag, far, _CMP_GT_OQ);
+        far_z = _mm512_mask_mov_pd(far_z, arrived, mag);
+        far_dz = _mm512_mask_mov_pd(far_dz, arrived, _mm512_fmadd_pd(dr, dr, _mm512_mul_pd(di, di)));
+        active &= (__mmask8)~arrived;
+        if (active == 0) {
+            break;
+        }
+        n = _mm512_mask_add_epi64(n, counting, n, one);
+        __m512d two_r = _mm512_add_pd(zr, zr), two_i = _mm512_add_pd(zi, zi);
+        __m512d next_dr = _mm512_add_pd(_mm512_fmsub_pd(two_r, dr, _mm512_mul_pd(two_i, di)), offset);
+        di = _mm512_fmadd_pd(two_r, di, _mm512_mul_pd(two_i, dr));
+        dr = next_dr;
+        zi = _mm512_fmadd_pd(two_r, zi, ci);
+        zr = _mm512_add_pd(_mm512_sub_pd(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __mmask8 cycled = _mm512_mask_cmp_pd_mask(counting, zr, sr, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_pd_mask(cycled, zi, si, _CMP_EQ_OQ);
+        if (cycled != 0) {
+            n = _mm512_mask_mov_epi64(n, cycled, cap);
+            periodic |= cycled;
+            counting &= (__mmask8)~cycled;
+            active &= (__mmask8)~cycled;
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    far_z = _mm512_mask_mov_pd(far_z, active, _mm512_fmadd_pd(zr, zr, _mm512_mul_pd(zi, zi)));
+    far_dz = _mm512_mask_mov_pd(far_dz, active, _mm512_fmadd_pd(dr, dr, _mm512_mul_pd(di, di)));
+
+    long long counts[8];
+    double norms[8], zz[8], dd[8];
+    _mm512_storeu_si512(counts, n);
+    _mm512_storeu_pd(norms, norm);
+    _mm512_storeu_pd(zz, far_z);
+    _mm512_storeu_pd(dd, far_dz);
+    for (int l = 0; l < 8; l++) {
+        bool escaped = counts[l] < limit;
+        out[l] = p.smooth && escaped ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+        distance[l] = escaped && dd[l] > 0 ? std::sqrt(zz[l] / dd[l]) * std::log(zz[l]) : 0;
+    }
+    return periodic;
+}
+
+// Double-double blocks: DoubleDouble's operations lane by lane, with the high and low parts in
+// separate registers. The bailout only looks at the high parts of |z|^2, so a point exactly on the
+// radius can escape one step apart from escapeScalar<DoubleDouble>.
+struct Avx2DoubleDouble {
+    __m256d hi, lo;
+};
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble twoSum(__m256d a, __m256d b) {
+    __m256d s = _mm256_add_pd(a, b);
+    __m256d bb = _mm256_sub_pd(s, a);
+    return {s, _mm256_add_pd(_mm256_sub_pd(a, _mm256_sub_pd(s, bb)), _mm256_sub_pd(b, bb))};
+}
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble quickTwoSum(__m256d a, __m256d b) {
+    __m256d s = _mm256_add_pd(a, b);
+    return {s, _mm256_sub_pd(b, _mm256_sub_pd(s, a))};
+}
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble add(Avx2DoubleDouble a, Avx2DoubleDouble b) {
+    Avx2DoubleDouble s = twoSum(a.hi, b.hi), t = twoSum(a.lo, b.lo);
+    s = quickTwoSum(s.hi, _mm256_add_pd(s.lo, t.hi));
+    return quickTwoSum(s.hi, _mm256_add_pd(s.lo, t.lo));
+}
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble sub(Avx2DoubleDouble a, Avx2DoubleDouble b) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    return add(a, {_mm256_xor_pd(b.hi, sign), _mm256_xor_pd(b.lo, sign)});
+}
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble mul(Avx2DoubleDouble a, Avx2DoubleDouble b) {
+    __m256d p = _mm256_mul_pd(a.hi, b.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, b.hi, p);
+    e = _mm256_add_pd(e, _mm256_fmadd_pd(a.hi, b.lo, _mm256_mul_pd(a.lo, b.hi)));
+    return quickTwoSum(p, e);
+}
+
+__attribute__((target("avx2,fma")))
+inline Avx2DoubleDouble square(Avx2DoubleDouble a) {
+    __m256d p = _mm256_mul_pd(a.hi, a.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, a.hi, p);
+    e = _mm256_fmadd_pd(_mm256_add_pd(a.hi, a.hi), a.lo, e);
+    return quickTwoSum(p, e);
+}
+
+__attribute__((target("avx2,fma")))
+inline unsigned escapeAvx2BlockDoubleDouble(const double* xs, const double* ys, const EscapeParams& p,
+                                            double* out) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m256d bailout = _mm256_set1_pd(p.smooth ? smooth_bailout * smooth_bailout : 4.0);
+    const __m256i cap = _mm256_set1_epi64x(limit);
+    const __m256d zero = _mm256_setzero_pd();
+    Avx2DoubleDouble px = add({_mm256_set1_pd(p.origin_re.hi), _mm256_set1_pd(p.origin_re.lo)},
+                              {_mm256_loadu_pd(xs), zero});
+    Avx2DoubleDouble py = add({_mm256_set1_pd(p.origin_im.hi), _mm256_set1_pd(p.origin_im.lo)},
+                              {_mm256_loadu_pd(ys), zero});
+    Avx2DoubleDouble zr = p.julia ? px : Avx2DoubleDouble{zero, zero};
+    Avx2DoubleDouble zi = p.julia ? py : Avx2DoubleDouble{zero, zero};
+    Avx2DoubleDouble cr = p.julia ? Avx2DoubleDouble{_mm256_set1_pd(p.c_re), zero} : px;
+    Avx2DoubleDouble ci = p.julia ? Avx2DoubleDouble{_mm256_set1_pd(p.c_im), zero} : py;
+    Avx2DoubleDouble sr = zr, si = zi;
+    __m256d dr = _mm256_set1_pd(1.0), di = zero; // from the high parts, double is plenty for the test
+    const __m256d limit2 = _mm256_set1_pd(attraction_limit * attraction_limit);
+    __m256i n = _mm256_setzero_si256();
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d periodic = zero;
+    __m256d norm = zero;
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        Avx2DoubleDouble rr = square(zr);
+        Avx2DoubleDouble ii = square(zi);
+        __m256d mag = _mm256_add_pd(rr.hi, ii.hi);
+        __m256d inside = _mm256_cmp_pd(mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm256_blendv_pd(norm, mag, _mm256_andnot_pd(inside, active));
+        }
+        active = _mm256_and_pd(active, inside);
+        if (_mm256_movemask_pd(active) == 0) {
+            break;
+        }
+        n = _mm256_sub_epi64(n, _mm256_castpd_si256(active));
+        Avx2DoubleDouble product = mul(zr, zi);
+        zi = add({_mm256_add_pd(product.hi, product.hi), _mm256_add_pd(product.lo, product.lo)}, ci);
+        zr = add(sub(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __m256d same_r = _mm256_and_pd(_mm256_cmp_pd(zr.hi, sr.hi, _CMP_EQ_OQ), _mm256_cmp_pd(zr.lo, sr.lo, _CMP_EQ_OQ));
+        __m256d same_i = _mm256_and_pd(_mm256_cmp_pd(zi.hi, si.hi, _CMP_EQ_OQ), _mm256_cmp_pd(zi.lo, si.lo, _CMP_EQ_OQ));
+        __m256d cycled = _mm256_and_pd(active, _mm256_and_pd(same_r, same_i));
+        if (p.attraction) {
+            __m256d two_r = _mm256_add_pd(zr.hi, zr.hi), two_i = _mm256_add_pd(zi.hi, zi.hi);
+            __m256d next_dr = _mm256_fmsub_pd(two_r, dr, _mm256_mul_pd(two_i, di));
+            di = _mm256_fmadd_pd(two_r, di, _mm256_mul_pd(two_i, dr));
+            dr = next_dr;
+            __m256d d2 = _mm256_fmadd_pd(dr, dr, _mm256_mul_pd(di, di));
+            __m256d weighted = _mm256_mul_pd(d2, _mm256_set1_pd(attractionWeight(it + 1)));
+            __m256d attracted = _mm256_cmp_pd(weighted, limit2, _CMP_LT_OQ);
+            cycled = _mm256_or_pd(cycled, _mm256_and_pd(active, attracted));
+        }
+        if (_mm256_movemask_pd(cycled) != 0) {
+            n = _mm256_blendv_epi8(n, cap, _mm256_castpd_si256(cycled));
+            periodic = _mm256_or_pd(periodic, cycled);
+            active = _mm256_andnot_pd(cycled, active);
+            dr = _mm256_andnot_pd(cycled, dr); // finished lanes would decay into slow denormals
+            di = _mm256_andnot_pd(cycled, di);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    long long counts[4];
+    double norms[4];
+    _mm256_storeu_si256((__m256i*)counts, n);
+    _mm256_storeu_pd(norms, norm);
+    for (int l = 0; l < 4; l++) {
+        out[l] = p.smooth && counts[l] < limit ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+    }
+    return (unsigned)_mm256_movemask_pd(periodic);
+}
+
+struct Avx512DoubleDouble {
+    __m512d hi, lo;
+};
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble twoSum(__m512d a, __m512d b) {
+    __m512d s = _mm512_add_pd(a, b);
+    __m512d bb = _mm512_sub_pd(s, a);
+    return {s, _mm512_add_pd(_mm512_sub_pd(a, _mm512_sub_pd(s, bb)), _mm512_sub_pd(b, bb))};
+}
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble quickTwoSum(__m512d a, __m512d b) {
+    __m512d s = _mm512_add_pd(a, b);
+    return {s, _mm512_sub_pd(b, _mm512_sub_pd(s, a))};
+}
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble add(Avx512DoubleDouble a, Avx512DoubleDouble b) {
+    Avx512DoubleDouble s = twoSum(a.hi, b.hi), t = twoSum(a.lo, b.lo);
+    s = quickTwoSum(s.hi, _mm512_add_pd(s.lo, t.hi));
+    return quickTwoSum(s.hi, _mm512_add_pd(s.lo, t.lo));
+}
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble sub(Avx512DoubleDouble a, Avx512DoubleDouble b) {
+    const __m512d minus_one = _mm512_set1_pd(-1.0);
+    return add(a, {_mm512_mul_pd(b.hi, minus_one), _mm512_mul_pd(b.lo, minus_one)});
+}
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble mul(Avx512DoubleDouble a, Avx512DoubleDouble b) {
+    __m512d p = _mm512_mul_pd(a.hi, b.hi);
+    __m512d e = _mm512_fmsub_pd(a.hi, b.hi, p);
+    e = _mm512_add_pd(e, _mm512_fmadd_pd(a.hi, b.lo, _mm512_mul_pd(a.lo, b.hi)));
+    return quickTwoSum(p, e);
+}
+
+__attribute__((target("avx512f")))
+inline Avx512DoubleDouble square(Avx512DoubleDouble a) {
+    __m512d p = _mm512_mul_pd(a.hi, a.hi);
+    __m512d e = _mm512_fmsub_pd(a.hi, a.hi, p);
+    e = _mm512_fmadd_pd(_mm512_add_pd(a.hi, a.hi), a.lo, e);
+    return quickTwoSum(p, e);
+}
+
+__attribute__((target("avx512f")))
+inline unsigned escapeAvx512BlockDoubleDouble(const double* xs, const double* ys, const EscapeParams& p,
+                                              double* out) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m512d bailout = _mm512_set1_pd(p.smooth ? smooth_bailout * smooth_bailout : 4.0);
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i cap = _mm512_set1_epi64(limit);
+    const __m512d zero = _mm512_setzero_pd();
+    Avx512DoubleDouble px = add({_mm512_set1_pd(p.origin_re.hi), _mm512_set1_pd(p.origin_re.lo)},
+                                {_mm512_loadu_pd(xs), zero});
+    Avx512DoubleDouble py = add({_mm512_set1_pd(p.origin_im.hi), _mm512_set1_pd(p.origin_im.lo)},
+                                {_mm512_loadu_pd(ys), zero});
+    Avx512DoubleDouble zr = p.julia ? px : Avx512DoubleDouble{zero, zero};
+    Avx512DoubleDouble zi = p.julia ? py : Avx512DoubleDouble{zero, zero};
+    Avx512DoubleDouble cr = p.julia ? Avx512DoubleDouble{_mm512_set1_pd(p.c_re), zero} : px;
+    Avx512DoubleDouble ci = p.julia ? Avx512DoubleDouble{_mm512_set1_pd(p.c_im), zero} : py;
+    Avx512DoubleDouble sr = zr, si = zi;
+    __m512d dr = _mm512_set1_pd(1.0), di = zero;
+    const __m512d limit2 = _mm512_set1_pd(attraction_limit * attraction_limit);
+    __m512i n = _mm512_setzero_si512();
+    __mmask8 active = 0xFF;
+    __mmask8 periodic = 0;
+    __m512d norm = zero;
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        Avx512DoubleDouble rr = square(zr);
+        Avx512DoubleDouble ii = square(zi);
+        __m512d mag = _mm512_add_pd(rr.hi, ii.hi);
+        __mmask8 inside = _mm512_mask_cmp_pd_mask(active, mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm512_mask_mov_pd(norm, active & (__mmask8)~inside, mag);
+        }
+        active = inside;
+        if (active == 0) {
+            break;
+        }
+        n = _mm512_mask_add_epi64(n, active, n, one);
+        Avx512DoubleDouble product = mul(zr, zi);
+        zi = add({_mm512_add_pd(product.hi, product.hi), _mm512_add_pd(product.lo, product.lo)}, ci);
+        zr = add(sub(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __mmask8 cycled = _mm512_mask_cmp_pd_mask(active, zr.hi, sr.hi, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_pd_mask(cycled, zr.lo, sr.lo, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_pd_mask(cycled, zi.hi, si.hi, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_pd_mask(cycled, zi.lo, si.lo, _CMP_EQ_OQ);
+        if (p.attraction) {
+            __m512d two_r = _mm512_add_pd(zr.hi, zr.hi), two_i = _mm512_add_pd(zi.hi, zi.hi);
+            __m512d next_dr = _mm512_fmsub_pd(two_r, dr, _mm512_mul_pd(two_i, di));
+            di = _mm512_fmadd_pd(two_r, di, _mm512_mul_pd(two_i, dr));
+            dr = next_dr;
+            __m512d d2 = _mm512_fmadd_pd(dr, dr, _mm512_mul_pd(di, di));
+            __m512d weighted = _mm512_mul_pd(d2, _mm512_set1_pd(attractionWeight(it + 1)));
+            cycled |= _mm512_mask_cmp_pd_mask(active, weighted, limit2, _CMP_LT_OQ);
+        }
+        if (cycled != 0) {
+            n = _mm512_mask_mov_epi64(n, cycled, cap);
+            periodic |= cycled;
+            active &= (__mmask8)~cycled;
+            dr = _mm512_maskz_mov_pd((__mmask8)~cycled, dr);
+            di = _mm512_maskz_mov_pd((__mmask8)~cycled, di);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    long long counts[8];
+    double norms[8];
+    _mm512_storeu_si512(counts, n);
+    _mm512_storeu_pd(norms, norm);
+    for (int l = 0; l < 8; l++) {
+        out[l] = p.smooth && counts[l] < limit ? smoothCount(counts[l], norms[l]) : (double)counts[l];
+    }
+    return periodic;
+}
+
+// Float blocks take the points already rounded to float, count in int32 lanes and hand back the
+// escape |z|^2 for smooth colouring.
+__attribute__((target("avx2,fma")))
+inline unsigned escapeAvx2BlockFloat(const float* xs, const float* ys, const EscapeParams& p, int* out,
+                                     float* norms) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m256 bailout = _mm256_set1_ps(p.smooth ? (float)(smooth_bailout * smooth_bailout) : 4.0f);
+    const __m256i cap = _mm256_set1_epi32((int)std::min<long long>(limit, INT32_MAX));
+    __m256 px = _mm256_loadu_ps(xs);
+    __m256 py = _mm256_loadu_ps(ys);
+    __m256 zr = p.julia ? px : _mm256_setzero_ps();
+    __m256 zi = p.julia ? py : _mm256_setzero_ps();
+    __m256 cr = p.julia ? _mm256_set1_ps((float)p.c_re) : px;
+    __m256 ci = p.julia ? _mm256_set1_ps((float)p.c_im) : py;
+    __m256 sr = zr, si = zi;
+    __m256i n = _mm256_setzero_si256();
+    __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 periodic = _mm256_setzero_ps();
+    __m256 norm = _mm256_setzero_ps();
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m256 rr = _mm256_mul_ps(zr, zr);
+        __m256 ii = _mm256_mul_ps(zi, zi);
+        __m256 mag = _mm256_add_ps(rr, ii);
+        __m256 inside = _mm256_cmp_ps(mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm256_blendv_ps(norm, mag, _mm256_andnot_ps(inside, active));
+        }
+        active = _mm256_and_ps(active, inside);
+        if (_mm256_movemask_ps(active) == 0) {
+            break;
+        }
+        n = _mm256_sub_epi32(n, _mm256_castps_si256(active));
+        zi = _mm256_fmadd_ps(_mm256_add_ps(zr, zr), zi, ci);
+        zr = _mm256_add_ps(_mm256_sub_ps(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __m256 cycled = _mm256_and_ps(active, _mm256_and_ps(_mm256_cmp_ps(zr, sr, _CMP_EQ_OQ),
+                                                            _mm256_cmp_ps(zi, si, _CMP_EQ_OQ)));
+        if (_mm256_movemask_ps(cycled) != 0) {
+            n = _mm256_blendv_epi8(n, cap, _mm256_castps_si256(cycled));
+            periodic = _mm256_or_ps(periodic, cycled);
+            active = _mm256_andnot_ps(cycled, active);
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    _mm256_storeu_si256((__m256i*)out, n);
+    _mm256_storeu_ps(norms, norm);
+    return (unsigned)_mm256_movemask_ps(periodic);
+}
+
+__attribute__((target("avx512f")))
+inline unsigned escapeAvx512BlockFloat(const float* xs, const float* ys, const EscapeParams& p, int* out,
+                                       float* norms) {
+    const long long limit = (long long)iterationCap(p.max_iter);
+    const __m512 bailout = _mm512_set1_ps(p.smooth ? (float)(smooth_bailout * smooth_bailout) : 4.0f);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i cap = _mm512_set1_epi32((int)std::min<long long>(limit, INT32_MAX));
+    __m512 px = _mm512_loadu_ps(xs);
+    __m512 py = _mm512_loadu_ps(ys);
+    __m512 zr = p.julia ? px : _mm512_setzero_ps();
+    __m512 zi = p.julia ? py : _mm512_setzero_ps();
+    __m512 cr = p.julia ? _mm512_set1_ps((float)p.c_re) : px;
+    __m512 ci = p.julia ? _mm512_set1_ps((float)p.c_im) : py;
+    __m512 sr = zr, si = zi;
+    __m512i n = _mm512_setzero_si512();
+    __mmask16 active = 0xFFFF;
+    __mmask16 periodic = 0;
+    __m512 norm = _mm512_setzero_ps();
+    int steps = 0, next_save = 1;
+
+    for (long long it = 0; it < limit; it++) {
+        __m512 rr = _mm512_mul_ps(zr, zr);
+        __m512 ii = _mm512_mul_ps(zi, zi);
+        __m512 mag = _mm512_add_ps(rr, ii);
+        __mmask16 inside = _mm512_mask_cmp_ps_mask(active, mag, bailout, _CMP_LE_OQ);
+        if (p.smooth) {
+            norm = _mm512_mask_mov_ps(norm, active & (__mmask16)~inside, mag);
+        }
+        active = inside;
+        if (active == 0) {
+            break;
+        }
+        n = _mm512_mask_add_epi32(n, active, n, one);
+        zi = _mm512_fmadd_ps(_mm512_add_ps(zr, zr), zi, ci);
+        zr = _mm512_add_ps(_mm512_sub_ps(rr, ii), cr);
+
+        if (!p.shortcuts) {
+            continue;
+        }
+        __mmask16 cycled = _mm512_mask_cmp_ps_mask(active, zr, sr, _CMP_EQ_OQ);
+        cycled = _mm512_mask_cmp_ps_mask(cycled, zi, si, _CMP_EQ_OQ);
+        if (cycled != 0) {
+            n = _mm512_mask_mov_epi32(n, cycled, cap);
+            periodic |= cycled;
+            active &= (__mmask16)~cycled;
+        }
+        if (++steps == next_save) {
+            sr = zr;
+            si = zi;
+            steps = 0;
+            next_save *= 2;
+        }
+    }
+    _mm512_storeu_si512(out, n);
+    _mm512_storeu_ps(norms, norm);
+    return periodic;
+}
+
+#endif
+
+// Runs the kernel on already-compacted points; returns the periodicity bitmask (count <= 32).
+inline unsigned escapeCompact(SimdLevel level, const double* xs, const double* ys, int count, const EscapeParams& p,
+                              double* out) {
+    if (p.precision == Precision::LongDouble) {
+        return escapeScalar<long double>(xs, ys, count, p, out);
+    }
+#ifdef FTL_X86_SIMD
+    if (p.precision == Precision::Float && level != SimdLevel::Scalar) {
+        int lanes = level == SimdLevel::Avx512 ? 16 : 8;
+        auto block = level == SimdLevel::Avx512 ? escapeAvx512BlockFloat : escapeAvx2BlockFloat;
+        // round once, padding the last block with the last point so the block loads stay in bounds
+        float fx[32 + 16], fy[32 + 16];
+        int counts[32 + 16];
+        float norms[32 + 16];
+        for (int k = 0; k < (count + lanes - 1) / lanes * lanes; k++) {
+            fx[k] = pointCoord<float>(p.origin_re, xs[std::min(k, count - 1)]);
+            fy[k] = pointCoord<float>(p.origin_im, ys[std::min(k, count - 1)]);
+        }
+        unsigned periodic = 0;
+        for (int k = 0; k < count; k += lanes) {
+            periodic |= block(fx + k, fy + k, p, counts + k, norms + k) << k;
+        }
+        const long long limit = (long long)iterationCap(p.max_iter);
+        for (int k = 0; k < count; k++) {
+            out[k] = p.smooth && counts[k] < limit ? smoothCount(counts[k], norms[k]) : (double)counts[k];
+        }
+        return count < 32 ? periodic & ((1u << count) - 1) : periodic;
+    }
+    int lanes = level == SimdLevel::Avx512 ? 8 : level == SimdLevel::Avx2 ? 4 : 0;
+    if ((p.precision == Precision::Double || p.precision == Precision::DoubleDouble) && lanes > 0) {
+        auto block = p.precision == Precision::DoubleDouble
+                         ? (level == SimdLevel::Avx512 ? escapeAvx512BlockDoubleDouble : escapeAvx2BlockDoubleDouble)
+                         : (level == SimdLevel::Avx512 ? escapeAvx512Block : escapeAvx2Block);
+        unsigned periodic = 0;
+        int k = 0;
+        for (; k + lanes <= count; k += lanes) {
+            periodic |= block(xs + k, ys + k, p, out + k) << k;
+        }
+        if (k < count) {
+            // pad the tail with the last point so the block loads stay in bounds
+            double tail_x[8], tail_y[8], tail_out[8];
+            for (int l = 0; l < lanes; l++) {
+                tail_x[l] = xs[std::min(k + l, count - 1)];
+                tail_y[l] = ys[std::min(k + l, count - 1)];
+            }
+            unsigned tail = block(tail_x, tail_y, p, tail_out) & ((1u << (count - k)) - 1);
+            periodic |= tail << k;
+            std::copy(tail_out, tail_out + (count - k), out + k);
+        }
+        return periodic;
+    }
+#endif
+    if (p.precision == Precision::Float) {
+        return escapeScalar<float>(xs, ys, count, p, out);
+    }
+    if (p.precision == Precision::DoubleDouble) {
+        return escapeScalar<DoubleDouble>(xs, ys, count, p, out);
+    }
+    return escapeScalar<double>(xs, ys, count, p, out);
+}
+
+// escapeCompact() for the distance kernel, which has no float variant: float runs in double.
+inline unsigned escapeDistanceCompact(SimdLevel level, const double* xs, const double* ys, int count,
+                                      const EscapeParams& p, double* out, double* distance) {
+    if (p.precision == Precision::LongDouble) {
+        return escapeDistanceScalar<long double>(xs, ys, count, p, out, distance);
+    }
+    if (p.precision == Precision::DoubleDouble) {
+        return escapeDistanceScalar<DoubleDouble>(xs, ys, count, p, out, distance);
+    }
+#ifdef FTL_X86_SIMD
+    if (level != SimdLevel::Scalar) {
+        bool wide = level == SimdLevel::Avx512;
+        int lanes = wide ? 8 : 4;
+        auto block = [&](const double* bx, const double* by, double* bout, double* bdistance) {
+            return wide ? escapeAvx512BlockDistance(bx, by, p, bout, bdistance)
+                        : escapeAvx2BlockDistance(bx, by, p, bout, bdistance);
+        };
+        unsigned periodic = 0;
+        int k = 0;
+        for (; k + lanes <= count; k += lanes) {
+            periodic |= block(xs + k, ys + k, out + k, distance + k) << k;
+        }
+        if (k < count) {
+            double tail_x[8], tail_y[8], tail_out[8], tail_distance[8];
+            for (int l = 0; l < lanes; l++) {
+                tail_x[l] = xs[std::min(k + l, count - 1)];
+                tail_y[l] = ys[std::min(k + l, count - 1)];
+            }
+            unsigned tail = block(tail_x, tail_y, tail_out, tail_distance);
+            periodic |= (tail & ((1u << (count - k)) - 1)) << k;
+            std::copy(tail_out, tail_out + (count - k), out + k);
+            std::copy(tail_distance, tail_distance + (count - k), distance + k);
+        }
+        return periodic;
+    }
+#endif
+    return escapeDistanceScalar<double>(xs, ys, count, p, out, distance);
+}
+
+// Iteration counts for the points (xs[k], ys[k]), k < count. With distance, also their distance
+// estimates (escapeDistanceScalar()), 0 inside the set.
+inline void escapePoints(SimdLevel level, const double* xs, const double* ys, int count, const EscapeParams& p,
+                         double* out, EscapeStats* stats = nullptr, double* distance = nullptr) {
+    const int chunk = 32;
+    long long cardioid = 0, bulb = 0, periodic = 0;
+
+    for (int base = 0; base < count; base += chunk) {
+        int size = std::min(chunk, count - base);
+        double rest_x[chunk], rest_y[chunk], rest_out[chunk], rest_distance[chunk];
+        int rest_k[chunk];
+        int rest = 0;
+
+        for (int k = base; k < base + size; k++) {
+            double x = (double)p.origin_re + xs[k], y = (double)p.origin_im + ys[k];
+            if (p.shortcuts && !p.julia && inMainCardioid(x, y)) {
+                out[k] = iterationCap(p.max_iter);
+                cardioid++;
+            } else if (p.shortcuts && !p.julia && inPeriod2Bulb(x, y)) {
+                out[k] = iterationCap(p.max_iter);
+                bulb++;
+            } else {
+                rest_x[rest] = xs[k];
+                rest_y[rest] = ys[k];
+                rest_k[rest++] = k;
+            }
+        }
+
+        unsigned cycled = distance ? escapeDistanceCompact(level, rest_x, rest_y, rest, p, rest_out, rest_distance)
+                                   : escapeCompact(level, rest_x, rest_y, rest, p, rest_out);
+        for (int r = 0; r < rest; r++) {
+            out[rest_k[r]] = rest_out[r];
+        }
+        if (distance) {
+            for (int k = base; k < base + size; k++) {
+                distance[k] = 0; // the cardioid and the bulb
+            }
+            for (int r = 0; r < rest; r++) {
+                distance[rest_k[r]] = rest_distance[r];
+            }
+        }
+        for (; cycled != 0; cycled &= cycled - 1) {
+            periodic++;
+        }
+    }
+
+    if (stats) {
+        stats->points += count;
+        stats->cardioid += cardioid;
+        stats->bulb += bulb;
+        stats->periodic += periodic;
+    }
+}
+
+// Iteration counts for the points (xs[k], y), k < count.
+inline void escapeRow(SimdLevel level, const double* xs, double y, int count, const EscapeParams& p, double* out,
+                      EscapeStats* stats = nullptr) {
+    const int chunk = 32;
+    double ys[chunk];
+    std::fill(ys, ys + chunk, y);
+    for (int base = 0; base < count; base += chunk) {
+        escapePoints(level, xs + base, ys, std::min(chunk, count - base), p, out + base, stats);
+    }
+}
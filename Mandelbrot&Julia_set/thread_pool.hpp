@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, pops its own tasks from the back
+// and steals from the front of the others when it runs dry.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const {
+        return static_cast<unsigned>(workers.size());
+    }
+
+    void submit(std::function<void()> task) {
+        unsigned target = next_queue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    // Runs fn(0) .. fn(count - 1) on the pool and blocks until all of them are done.
+    // The calling thread steals work too instead of just sleeping.
+    template <typename F>
+    void parallelFor(int count, F fn) {
+        if (count <= 0) {
+            return;
+        }
+        auto remaining = std::make_shared<std::atomic<int>>(count);
+        auto done_mutex = std::make_shared<std::mutex>();
+        auto done = std::make_shared<std::condition_variable>();
+
+        for (int i = 0; i < count; i++) {
+            submit([i, &fn, remaining, done_mutex, done] {
+                fn(i);
+                if (--*remaining == 0) {
+                    std::lock_guard<std::mutex> lock(*done_mutex);
+                    done->notify_all();
+                }
+            });
+        }
+
+        while (*remaining > 0 && runOne(0)) {
+        }
+        std::unique_lock<std::mutex> lock(*done_mutex);
+        done->wait(lock, [&] { return *remaining == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue{0};
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    size_t pending = 0;
+    bool stopping = false;
+
+    bool popOwn(unsigned index, std::function<void()>& task) {
+        Queue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned index, std::function<void()>& task) {
+        Queue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool runOne(unsigned self) {
+        std::function<void()> task;
+        bool found = popOwn(self, task);
+        for (unsigned k = 1; !found && k < queues.size(); k++) {
+            found = steal((self + k) % queues.size(), task);
+        }
+        if (!found) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            pending--;
+        }
+        task();
+        return true;
+    }
+
+    void workerLoop(unsigned self) {
+        while (true) {
+            if (runOne(self)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping && pending == 0) {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,529 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "fractal.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FTL_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A quadtree of square tiles of escape counts, so work survives zooming and panning. Level L samples
+// the plane on the grid of spacing tileSpacing(L) = 2^-L / tile_side anchored at 0, and tile (tx, ty)
+// holds the tile_side x tile_side grid points from (tx, ty) * tile_side on, row-major. The grid of
+// level L is every other point of level L + 1: a tile is exactly the even samples of its four
+// children, and a quarter of every child is already known from its parent.
+//
+// max_iter is not part of the key but stored with the tile, since the app raises it on every zoom.
+// A tile computed with at least the current max_iter serves as it is, its counts past the cap
+// reading as interior; from one computed with less, the samples that escaped before its cap are
+// still exact (see sampleKnown()) and only the others are computed again.
+//
+// Recently used tiles stay in memory. With a pack file every new tile is also appended there, by a
+// writer thread so the workers computing tiles never wait on the disk, and the pack is memory-mapped
+// when the store opens, so the tiles of earlier runs are served straight from the mapping without
+// being read or copied.
+//
+// Pack layout, native byte order, every part starting on a pack_align boundary:
+//   header:  "FTLTILES", format version, kernel version, tile_side (uint32 each)
+//   entries: level (int32), tx, ty (int64), max_iter (double), formula length, encoding and data
+//            size (uint32 each), the formula, then the data: tile_samples floats (raw) or
+//            (run length uint32, count float) pairs (rle, for tiles that shrink to half or less).
+//            A tile computed again with a larger max_iter is appended once more; the entry with
+//            the largest max_iter wins.
+// A pack written by another kernel version or format is started over; a torn entry at the end (a
+// crash mid-append) is cut off.
+
+const int tile_side = 64;
+const int tile_samples = tile_side * tile_side;
+
+inline int64_t floorDiv(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+inline double tileSpacing(int level) {
+    return std::ldexp(1.0, -level) / tile_side;
+}
+
+// The coarsest level whose samples are at most `spacing` apart.
+inline int tileLevel(double spacing) {
+    int level = (int)std::ceil(-std::log2(spacing * tile_side));
+    return tileSpacing(level) > spacing ? level + 1 : level; // log2 rounding at exact powers of two
+}
+
+struct TileKey {
+    int level;
+    int64_t tx, ty;
+    std::string formula; // the set, its constant and the count mode: whatever else changes the counts
+
+    bool operator<(const TileKey& other) const {
+        return std::tie(level, tx, ty, formula) < std::tie(other.level, other.tx, other.ty, other.formula);
+    }
+
+    TileKey parent() const {
+        return {level - 1, floorDiv(tx, 2), floorDiv(ty, 2), formula};
+    }
+
+    // k = 0..3: top-left, top-right, bottom-left, bottom-right
+    TileKey child(int k) const {
+        return {level + 1, 2 * tx + (k & 1), 2 * ty + (k >> 1), formula};
+    }
+};
+
+struct Tile {
+    std::shared_ptr<const float> counts; // tile_samples counts, possibly inside a mapped pack
+    double max_iter = 0;                 // the one they were computed with
+
+    explicit operator bool() const {
+        return counts != nullptr;
+    }
+
+    const float* get() const {
+        return counts.get();
+    }
+};
+
+inline Tile makeTile(std::vector<float> counts, double max_iter) {
+    auto owner = std::make_shared<std::vector<float>>(std::move(counts));
+    return {std::shared_ptr<const float>(owner, owner->data()), max_iter};
+}
+
+// Whether a count from a tile computed with tile_max_iter is also the count with max_iter: all of
+// them are when the tile ran at least as far (those past the cap then mean interior), otherwise
+// those that escaped before the tile's cap.
+inline bool sampleKnown(float count, double tile_max_iter, double max_iter) {
+    return tile_max_iter >= max_iter || count < (float)iterationCap(tile_max_iter);
+}
+
+// The tile from the even samples of its children, in child(k) order.
+inline Tile decimateChildren(const Tile children[4]) {
+    std::vector<float> counts(tile_samples);
+    double max_iter = children[0].max_iter;
+    const int half = tile_side / 2;
+    for (int y = 0; y < tile_side; y++) {
+        for (int x = 0; x < tile_side; x++) {
+            const float* child = children[(y >= half) * 2 + (x >= half)].get();
+            counts[y * tile_side + x] = child[(2 * y % tile_side) * tile_side + 2 * x % tile_side];
+        }
+    }
+    for (int k = 1; k < 4; k++) {
+        max_iter = std::min(max_iter, children[k].max_iter);
+    }
+    return makeTile(std::move(counts), max_iter);
+}
+
+// Copies the samples of `key` that `from`, the tile itself computed with another max_iter or its
+// parent, holds and that are still exact with max_iter, and marks them in known. Counts are capped
+// at max_iter, so a tile never holds counts past its own cap.
+inline void inheritSamples(const TileKey& key, const Tile& from, bool parent, double max_iter,
+                           std::vector<float>& counts, std::vector<uint8_t>& known) {
+    const int half = tile_side / 2, step = parent ? 2 : 1;
+    int x0 = parent ? (int)(key.tx & 1) * half : 0, y0 = parent ? (int)(key.ty & 1) * half : 0;
+    float cap = (float)iterationCap(max_iter);
+    for (int y = 0; y < tile_side; y += step) {
+        for (int x = 0; x < tile_side; x += step) {
+            float count = from.get()[(y0 + y / step) * tile_side + x0 + x / step];
+            if (sampleKnown(count, from.max_iter, max_iter)) {
+                counts[y * tile_side + x] = std::min(count, cap);
+                known[y * tile_side + x] = 1;
+            }
+        }
+    }
+}
+
+// A whole file, read-only: mapped where the platform has mmap, read into memory elsewhere.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef FTL_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = (const uint8_t*)mapped;
+                length = (size_t)info.st_size;
+            }
+        }
+        close(fd); // the mapping stays valid
+#else
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return;
+        }
+        uint8_t chunk[1 << 16];
+        for (size_t got; (got = fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+            copy.insert(copy.end(), chunk, chunk + got);
+        }
+        fclose(file);
+        bytes = copy.data();
+        length = copy.size();
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef FTL_MMAP
+        if (bytes) {
+            munmap((void*)bytes, length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+#ifndef FTL_MMAP
+    std::vector<uint8_t> copy;
+#endif
+};
+
+// Thread-safe; tiles are immutable once stored, so a found tile can be read without the lock. The
+// lock only guards the maps: reads and writes of the pack happen outside it.
+class TileStore {
+public:
+    static const uint32_t pack_format = 1;
+    static const size_t pack_align = 64;
+
+    // kernel_version: see simd_kernels.hpp. The pack stops growing at pack_bytes.
+    TileStore(size_t memory_tiles, const std::string& pack_path = "", uint32_t kernel_version = 0,
+              uint64_t pack_bytes = 0)
+        : memory_tiles(memory_tiles), pack_path(pack_path), kernel_version(kernel_version), pack_bytes(pack_bytes) {
+        if (!pack_path.empty()) {
+            openPack();
+        }
+        if (pack) {
+            writer = std::thread([this] { writeQueued(); });
+        }
+    }
+
+    // Waits for the tiles still queued for the pack.
+    ~TileStore() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closing = true;
+            }
+            wake.notify_one();
+            writer.join();
+        }
+        if (pack) {
+            fclose(pack);
+        }
+    }
+
+    // From memory, or from the pack, whatever max_iter it was computed with; empty if neither has it.
+    Tile find(const TileKey& key, bool* from_disk = nullptr) {
+        if (from_disk) {
+            *from_disk = false;
+        }
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = memory.find(key);
+            if (found != memory.end()) {
+                order.splice(order.begin(), order, found->second.second);
+                return found->second.first;
+            }
+            auto packed = index.find(key);
+            if (packed == index.end()) {
+                return {};
+            }
+            entry = packed->second;
+        }
+        Tile tile = load(entry);
+        if (!tile) {
+            return tile;
+        }
+        if (from_disk) {
+            *from_disk = true;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = memory.find(key); // another thread may have stored it meanwhile
+        if (found != memory.end() && found->second.first.max_iter >= tile.max_iter) {
+            return found->second.first;
+        }
+        if (found != memory.end()) {
+            order.erase(found->second.second);
+            memory.erase(found);
+        }
+        remember(key, tile);
+        return tile;
+    }
+
+    // Memory only and without touching the recency order, for previews.
+    Tile peek(const TileKey& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = memory.find(key);
+        return found != memory.end() ? found->second.first : Tile();
+    }
+
+    // Replaces the stored tile unless that one was computed with a larger max_iter.
+    void insert(const TileKey& key, Tile tile) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = memory.find(key);
+        if (found != memory.end()) {
+            if (found->second.first.max_iter > tile.max_iter) {
+                return;
+            }
+            order.erase(found->second.second);
+            memory.erase(found);
+        }
+        remember(key, tile);
+        if (writer.joinable()) {
+            queue.emplace_back(key, tile);
+            wake.notify_one();
+        }
+    }
+
+    // Tiles in the pack, including the ones mapped at open; not yet the ones still queued.
+    size_t packed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.size();
+    }
+
+private:
+    std::mutex mutex;
+    size_t memory_tiles;
+    std::string pack_path;
+    uint32_t kernel_version;
+    uint64_t pack_bytes;
+
+    std::list<TileKey> order; // most recently used first
+    std::map<TileKey, std::pair<Tile, std::list<TileKey>::iterator>> memory;
+
+    enum Encoding : uint32_t { raw = 0, rle = 1 };
+    struct Entry {
+        uint64_t offset; // of the data
+        uint32_t encoding, size;
+        double max_iter;
+    };
+    std::map<TileKey, Entry> index;
+    std::shared_ptr<MappedFile> mapping; // the pack as it was at open; owner of every tile served from it
+    uint64_t mapped_end = 0; // the valid part of the mapping: a torn tail cut off at open stays mapped
+
+    // The writer thread appends the queued tiles and only then enters them in the index. file_mutex
+    // guards the FILE, shared with the reads of tiles appended since open; pack_end is the writer's.
+    std::deque<std::pair<TileKey, Tile>> queue;
+    std::condition_variable wake;
+    bool closing = false;
+    std::thread writer;
+    std::mutex file_mutex;
+    FILE* pack = nullptr; // for appending, and for reading what was appended since
+    uint64_t pack_end = 0;
+
+    static uint64_t aligned(uint64_t offset) {
+        return (offset + pack_align - 1) / pack_align * pack_align;
+    }
+
+    void remember(const TileKey& key, const Tile& tile) {
+        order.push_front(key);
+        memory[key] = {tile, order.begin()};
+        while (memory.size() > memory_tiles) {
+            memory.erase(order.back());
+            order.pop_back();
+        }
+    }
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t format, kernel, side, reserved;
+    };
+
+    struct EntryHeader {
+        int32_t level;
+        uint32_t formula_size;
+        int64_t tx, ty;
+        double max_iter;
+        uint32_t encoding, size;
+    };
+
+    void openPack() {
+        FileHeader expected = {{'F', 'T', 'L', 'T', 'I', 'L', 'E', 'S'}, pack_format, kernel_version, tile_side, 0};
+        mapping = std::make_shared<MappedFile>(pack_path);
+        const uint8_t* data = mapping->data();
+        size_t size = mapping->size();
+
+        bool valid = size >= sizeof(FileHeader) && memcmp(data, &expected, sizeof(FileHeader)) == 0;
+        uint64_t end = valid ? aligned(sizeof(FileHeader)) : 0;
+        while (valid) {
+            EntryHeader header;
+            if (end + sizeof(header) > size) {
+                break;
+            }
+            memcpy(&header, data + end, sizeof(header));
+            uint64_t formula_at = end + sizeof(header);
+            uint64_t data_at = aligned(formula_at + header.formula_size);
+            if (header.encoding > rle || data_at + header.size > size ||
+                (header.encoding == raw && header.size != tile_samples * sizeof(float))) {
+                break;
+            }
+            TileKey key = {header.level, header.tx, header.ty,
+                           std::string((const char*)data + formula_at, header.formula_size)};
+            auto known = index.find(key);
+            if (known == index.end() || known->second.max_iter <= header.max_iter) {
+                index[key] = {data_at, header.encoding, header.size, header.max_iter};
+            }
+            end = aligned(data_at + header.size);
+        }
+
+        if (!valid) {
+            mapping.reset();
+            pack = fopen(pack_path.c_str(), "w+b");
+            valid = pack && fwrite(&expected, sizeof(expected), 1, pack) == 1;
+            end = aligned(sizeof(expected));
+        } else {
+            pack = fopen(pack_path.c_str(), "r+b");
+            if (end < size) {
+                std::error_code error;
+                std::filesystem::resize_file(pack_path, std::min<uint64_t>(end, size), error);
+            }
+        }
+        if (!valid && pack) {
+            fclose(pack);
+            pack = nullptr;
+        }
+        pack_end = end;
+        mapped_end = mapping ? end : 0;
+    }
+
+    // Without the store lock. Tiles appended since open are read through the FILE, whose seek
+    // writes out what is still buffered.
+    Tile load(const Entry& entry) {
+        std::vector<uint8_t> read;
+        const uint8_t* data;
+        if (mapping && entry.offset + entry.size <= mapped_end) {
+            data = mapping->data() + entry.offset;
+            if (entry.encoding == raw) {
+                // no copy: the tile points into the mapping
+                return {std::shared_ptr<const float>(mapping, (const float*)data), entry.max_iter};
+            }
+        } else {
+            read.resize(entry.size);
+            std::lock_guard<std::mutex> lock(file_mutex);
+            if (!pack || fseek(pack, (long)entry.offset, SEEK_SET) != 0 ||
+                fread(read.data(), 1, read.size(), pack) != read.size()) {
+                return {};
+            }
+            data = read.data();
+        }
+
+        std::vector<float> counts;
+        if (entry.encoding == raw) {
+            counts.resize(tile_samples);
+            memcpy(counts.data(), data, entry.size);
+        } else {
+            counts.reserve(tile_samples);
+            for (uint32_t at = 0; at + 8 <= entry.size; at += 8) {
+                uint32_t run;
+                float value;
+                memcpy(&run, data + at, 4);
+                memcpy(&value, data + at + 4, 4);
+                counts.insert(counts.end(), std::min<size_t>(run, tile_samples - counts.size()), value);
+            }
+            if (counts.size() != tile_samples) {
+                return {};
+            }
+        }
+        return makeTile(std::move(counts), entry.max_iter);
+    }
+
+    void writeQueued() {
+        for (;;) {
+            std::pair<TileKey, Tile> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return closing || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                item = std::move(queue.front());
+                queue.pop_front();
+                auto known = index.find(item.first);
+                if (known != index.end() && known->second.max_iter >= item.second.max_iter) {
+                    continue;
+                }
+            }
+            Entry entry;
+            if (!append(item.first, item.second, entry)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            index[item.first] = entry;
+        }
+    }
+
+    // On the writer thread, without the store lock.
+    bool append(const TileKey& key, const Tile& tile, Entry& entry) {
+        const float* counts = tile.get();
+        std::vector<uint8_t> runs;
+        for (int k = 0; k < tile_samples;) {
+            uint32_t run = 1;
+            while (k + (int)run < tile_samples && counts[k + run] == counts[k]) {
+                run++;
+            }
+            runs.insert(runs.end(), (const uint8_t*)&run, (const uint8_t*)&run + 4);
+            runs.insert(runs.end(), (const uint8_t*)&counts[k], (const uint8_t*)&counts[k] + 4);
+            k += run;
+        }
+        bool compress = runs.size() * 2 <= tile_samples * sizeof(float);
+        const uint8_t* data = compress ? runs.data() : (const uint8_t*)counts;
+        uint32_t size = compress ? (uint32_t)runs.size() : (uint32_t)(tile_samples * sizeof(float));
+
+        EntryHeader header = {key.level, (uint32_t)key.formula.size(), key.tx, key.ty, tile.max_iter,
+                              compress ? (uint32_t)rle : (uint32_t)raw, size};
+        uint64_t data_at = aligned(pack_end + sizeof(header) + key.formula.size());
+        uint64_t next = aligned(data_at + size);
+        if (pack_bytes > 0 && next > pack_bytes) {
+            return false;
+        }
+        std::vector<uint8_t> bytes(next - pack_end, 0);
+        memcpy(bytes.data(), &header, sizeof(header));
+        memcpy(bytes.data() + sizeof(header), key.formula.data(), key.formula.size());
+        memcpy(bytes.data() + (data_at - pack_end), data, size);
+
+        // no flush per tile: a torn entry after a crash is cut off at the next open
+        std::lock_guard<std::mutex> lock(file_mutex);
+        if (!pack) {
+            return false;
+        }
+        if (fseek(pack, (long)pack_end, SEEK_SET) != 0 || fwrite(bytes.data(), 1, bytes.size(), pack) != bytes.size()) {
+            fclose(pack);
+            pack = nullptr;
+            return false;
+        }
+        entry = {data_at, header.encoding, size, tile.max_iter};
+        pack_end = next;
+        return true;
+    }
+};
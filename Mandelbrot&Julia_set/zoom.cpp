@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "fractal.hpp"
+#include "thread_pool.hpp"
+#include "simd_kernels.hpp"
+#include "fixed_point.hpp"
+#include "perturbation.hpp"
+#include "palette.hpp"
+#include "args.hpp"
+
+using namespace std;
+
+// Zoom videos: a constant-speed exponential zoom into a target point, streamed as raw RGB24 frames.
+// ftl_zoom --center -0.743643887037158704752191506114774 0.131825904205311970493132056385139 --zoom 1e12
+//          --frames 900 --size 1280x720 --iter 5000 --out - |
+//     ffmpeg -f rawvideo -pix_fmt rgb24 -s 1280x720 -r 30 -i - zoom.mp4
+//
+// Only keyframes are rendered: keyframe k spans span / K^k and has K times the output resolution
+// (K = --keyframe, 2 to 4, 2 by default), so every frame between it and the next one is a crop of it with
+// between 1 and K keyframe pixels per output pixel, area-resampled instead of computed. Past double
+// precision the keyframes switch to perturbation, all of them around one reference orbit at the
+// target. Counts are always smooth, so the resampled frames do not flicker between bands.
+
+struct ZoomJob {
+    int width = 1280, height = 720;
+    string center_x = "-0.75", center_y = "0"; // decimal strings so deep targets keep all their digits
+    double span = 4;                          // width of the first frame in the complex plane
+    double zoom = 1e3;                        // span of the first frame / span of the last
+    int frames = 300;
+    int keyframe = 2;
+    double max_iter = 1000;
+    char set_name = 'm';
+    double c_re = -0.7, c_im = 0.27015;
+    unsigned threads = 0;
+    string out = "-";
+    string palette = "classic";
+    bool attraction = false; // the heuristic interior test, see EscapeParams
+};
+
+static void usage() {
+    cerr << "usage: ftl_zoom [--size WxH] [--center re im] [--span S] [--zoom factor] [--frames N]\n"
+            "                [--keyframe K] [--iter N] [--set m|j] [--c re im] [--threads N]\n"
+            "                [--palette name|file] [--out file.rgb|-] [--attraction]\n";
+}
+
+static bool parseArgs(int argc, char* argv[], ZoomJob& job) {
+    for (int k = 1; k < argc; k++) {
+        string arg = argv[k];
+        auto need = [&](int count) { return k + count < argc; };
+        auto report = [&](bool parsed, const char* what) {
+            if (!parsed) {
+                cerr << "ftl_zoom: " << arg << " takes " << what << ", not " << argv[k] << '\n';
+            }
+            return parsed;
+        };
+        auto number = [&](double& value) { return report(parseNumber(argv[++k], value), "numbers"); };
+
+        if (arg == "--size" && need(1)) {
+            if (sscanf(argv[++k], "%dx%d", &job.width, &job.height) != 2 || job.width <= 0 || job.height <= 0) {
+                return false;
+            }
+        } else if (arg == "--center" && need(2)) {
+            job.center_x = argv[++k];
+            job.center_y = argv[++k];
+        } else if (arg == "--span" && need(1)) {
+            if (!number(job.span)) {
+                return false;
+            }
+        } else if (arg == "--zoom" && need(1)) {
+            if (!number(job.zoom)) {
+                return false;
+            }
+        } else if (arg == "--frames" && need(1)) {
+            if (!report(parseCount(argv[++k], job.frames), "a frame count")) {
+                return false;
+            }
+        } else if (arg == "--keyframe" && need(1)) {
+            if (!report(parseCount(argv[++k], job.keyframe), "a whole number")) {
+                return false;
+            }
+        } else if (arg == "--iter" && need(1)) {
+            if (!number(job.max_iter)) {
+                return false;
+            }
+        } else if (arg == "--set" && need(1)) {
+            job.set_name = argv[++k][0];
+            if (job.set_name != 'm' && job.set_name != 'j') {
+                return false;
+            }
+        } else if (arg == "--c" && need(2)) {
+            if (!number(job.c_re) || !number(job.c_im)) {
+                return false;
+            }
+        } else if (arg == "--threads" && need(1)) {
+            if (!report(parseCount(argv[++k], job.threads), "a thread count")) {
+                return false;
+            }
+        } else if (arg == "--palette" && need(1)) {
+            job.palette = argv[++k];
+        } else if (arg == "--out" && need(1)) {
+            job.out = argv[++k];
+        } else if (arg == "--attraction") {
+            job.attraction = true;
+        } else {
+            return false;
+        }
+    }
+    return job.span > 0 && job.zoom >= 1 && job.frames > 0 && job.keyframe >= 2 && job.keyframe <= 4;
+}
+
+struct Keyframe {
+    int width, height; // keyframe pixels
+    double span_x, span_y;
+    vector<uint32_t> pixels; // packed RGBA from the palette
+};
+
+// Everything shared by the keyframes: the target and, once a keyframe needs it, the reference orbit.
+struct ZoomState {
+    FixedPoint center_x, center_y;
+    EscapeParams params;
+    bool have_orbit = false;
+    ReferenceOrbit orbit;
+};
+
+// Renders the keyframe of the given span centred on the target, sampling at pixel centres so the
+// target stays exactly in the middle. Returns a description of the method for the progress line.
+static string renderKeyframe(const ZoomJob& job, ZoomState& state, ThreadPool& pool, SimdLevel simd_level,
+                             const Palette& palette, Keyframe& key) {
+    const int tile_size = 32;
+    int w = key.width, h = key.height;
+    double spacing = key.span_x / w;
+    EscapeParams params = state.params;
+    params.origin_re = state.center_x.toDoubleDouble() - key.span_x / 2;
+    params.origin_im = state.center_y.toDoubleDouble() - key.span_y / 2;
+    double scale = max(fabs((double)state.center_x.toLongDouble()), fabs((double)state.center_y.toLongDouble())) +
+                   key.span_x / 2;
+    params.precision = selectPrecision(spacing, scale, job.max_iter);
+
+    bool deep = !precisionFits(params.precision, spacing, scale);
+    SeriesApproximation series;
+    if (deep) {
+        if (!state.have_orbit) {
+            // the target is the reference of every deep keyframe, so one orbit serves the rest of the video
+            state.orbit = referenceOrbit(state.center_x, state.center_y, params);
+            state.have_orbit = true;
+        }
+        series = seriesApproximation(state.orbit, params, key.span_x / 2, key.span_y / 2, spacing);
+    }
+
+    int tiles_x = (w + tile_size - 1) / tile_size;
+    int tiles_y = (h + tile_size - 1) / tile_size;
+    vector<float> counts((size_t)w * h);
+    pool.parallelFor(tiles_x * tiles_y, [&](int tile) {
+        int i_begin = (tile % tiles_x) * tile_size;
+        int j_begin = (tile / tiles_x) * tile_size;
+        int i_end = min(i_begin + tile_size, w);
+        int j_end = min(j_begin + tile_size, h);
+        int count = i_end - i_begin;
+
+        // offsets from the top-left corner, or from the target for perturbation
+        double xs[tile_size], iters[tile_size];
+        for (int i = i_begin; i < i_end; i++) {
+            xs[i - i_begin] = key.span_x * (i + 0.5) / w - (deep ? key.span_x / 2 : 0);
+        }
+        for (int j = j_begin; j < j_end; j++) {
+            double y = key.span_y * (j + 0.5) / h - (deep ? key.span_y / 2 : 0);
+            if (deep) {
+                perturbRow(state.orbit, &series, xs, y, count, params, iters);
+            } else {
+                escapeRow(simd_level, xs, y, count, params, iters);
+            }
+            for (int i = i_begin; i < i_end; i++) {
+                counts[(size_t)j * w + i] = (float)iters[i - i_begin];
+            }
+        }
+    });
+
+    key.pixels.resize(counts.size());
+    pool.parallelFor(h, [&](int j) {
+        palette.colorize(&counts[(size_t)j * w], w, &key.pixels[(size_t)j * w]);
+    });
+    return deep ? "perturbation, series skips " + to_string(series.skip) : precisionName(params.precision);
+}
+
+// Source pixels of the keyframe under [begin, begin + size) and their share of it.
+struct Footprint {
+    int first = 0, count = 0;
+    float weights[6]; // at most 4 keyframe pixels per output pixel, so at most 5 partly covered
+};
+
+static Footprint footprint(double begin, double size, int limit) {
+    Footprint f;
+    int first = (int)floor(begin), last = (int)ceil(begin + size) - 1;
+    f.first = first;
+    for (int p = first; p <= last && f.count < 6; p++) {
+        double overlap = min((double)p + 1, begin + size) - max((double)p, begin);
+        f.weights[f.count++] = (float)(overlap / size);
+    }
+    // clamp at the keyframe edge, where rounding can reach one pixel past it
+    if (f.first < 0) {
+        f.first = 0;
+    }
+    if (f.first + f.count > limit) {
+        f.first = max(0, limit - f.count);
+    }
+    return f;
+}
+
+// The output frame of the given span as an area average over the centre of the keyframe.
+static void resampleFrame(const ZoomJob& job, const Keyframe& key, double span_x, ThreadPool& pool,
+                          vector<Rgb>& frame) {
+    double ratio = span_x / key.span_x * key.width / job.width; // keyframe pixels per output pixel
+    double x0 = key.width / 2.0 - job.width / 2.0 * ratio, y0 = key.height / 2.0 - job.height / 2.0 * ratio;
+    vector<Footprint> columns(job.width);
+    for (int i = 0; i < job.width; i++) {
+        columns[i] = footprint(x0 + i * ratio, ratio, key.width);
+    }
+    frame.resize((size_t)job.width * job.height);
+
+    pool.parallelFor(job.height, [&](int j) {
+        Footprint rows = footprint(y0 + j * ratio, ratio, key.height);
+        for (int i = 0; i < job.width; i++) {
+            const Footprint& cols = columns[i];
+            float r = 0, g = 0, b = 0;
+            for (int v = 0; v < rows.count; v++) {
+                const uint32_t* src = &key.pixels[(size_t)(rows.first + v) * key.width + cols.first];
+                for (int u = 0; u < cols.count; u++) {
+                    float weight = rows.weights[v] * cols.weights[u];
+                    r += weight * (src[u] & 0xff);
+                    g += weight * (src[u] >> 8 & 0xff);
+                    b += weight * (src[u] >> 16 & 0xff);
+                }
+            }
+            frame[(size_t)j * job.width + i] = {(uint8_t)(r + 0.5f), (uint8_t)(g + 0.5f), (uint8_t)(b + 0.5f)};
+        }
+    });
+}
+
+static double elapsedMs(chrono::steady_clock::time_point since) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, char* argv[]) {
+    ZoomJob job;
+    if (!parseArgs(argc, argv, job)) {
+        usage();
+        return 1;
+    }
+    // enough digits of the target for the pixels of the deepest keyframe
+    ZoomState state;
+    int frac = FixedPoint::limbsFor(job.span / job.zoom / (job.width * job.keyframe));
+    if (!FixedPoint::fromString(job.center_x, frac, state.center_x) ||
+        !FixedPoint::fromString(job.center_y, frac, state.center_y)) {
+        cerr << "ftl_zoom: --center takes plain decimals such as -0.7436438870371587, not " << job.center_x << ' '
+             << job.center_y << '\n';
+        return 1;
+    }
+
+    Gradient gradient;
+    if (!findGradient(job.palette, gradient)) {
+        cerr << "ftl_zoom: no palette or gradient file " << job.palette << '\n';
+        return 1;
+    }
+    Palette palette;
+    palette.build(gradient, job.max_iter);
+
+    FILE* out = job.out == "-" ? stdout : fopen(job.out.c_str(), "wb");
+    if (!out) {
+        cerr << "ftl_zoom: cannot write " << job.out << '\n';
+        return 1;
+    }
+    cerr << "ftl_zoom: " << job.frames << " frames of " << job.width << 'x' << job.height
+         << " rgb24, e.g. ffmpeg -f rawvideo -pix_fmt rgb24 -s " << job.width << 'x' << job.height
+         << " -r 30 -i " << (job.out == "-" ? "-" : job.out) << " zoom.mp4\n";
+
+    state.params = {job.set_name == 'j', job.c_re, job.c_im, job.max_iter};
+    state.params.smooth = true;
+    state.params.attraction = job.attraction;
+
+    ThreadPool pool(job.threads);
+    SimdLevel simd_level = detectSimd();
+    Keyframe key = {job.width * job.keyframe, job.height * job.keyframe, 0, 0, {}};
+    int key_index = -1;
+    vector<Rgb> frame;
+    auto start = chrono::steady_clock::now();
+
+    for (int n = 0; n < job.frames; n++) {
+        // constant speed: the span shrinks by the same factor every frame
+        double progress = job.frames > 1 ? (double)n / (job.frames - 1) : 0;
+        double span_x = job.span * pow(job.zoom, -progress);
+        // the deepest keyframe that still covers the frame; the small slack absorbs rounding at the boundaries
+        int index = max(0, (int)floor(log(job.span / span_x) / log((double)job.keyframe) + 1e-9));
+        if (index != key_index) {
+            auto key_start = chrono::steady_clock::now();
+            key_index = index;
+            key.span_x = job.span / pow((double)job.keyframe, index);
+            key.span_y = key.span_x * job.height / job.width;
+            string method = renderKeyframe(job, state, pool, simd_level, palette, key);
+            cerr << "keyframe " << index << " at frame " << n << ": span " << key.span_x << ", " << method << ", "
+                 << elapsedMs(key_start) << " ms\n";
+        }
+        resampleFrame(job, key, span_x, pool, frame);
+        if (fwrite(frame.data(), sizeof(Rgb), frame.size(), out) != frame.size()) {
+            cerr << "ftl_zoom: cannot write " << job.out << '\n';
+            return 1;
+        }
+    }
+    if (out != stdout && fclose(out) != 0) {
+        cerr << "ftl_zoom: cannot write " << job.out << '\n';
+        return 1;
+    }
+    cerr << "ftl_zoom: " << job.frames << " frames from " << key_index + 1 << " keyframes in " << elapsedMs(start)
+         << " ms\n";
+    return 0;
+}